@@ -0,0 +1,76 @@
+//
+// Copyright Metaspex - 2024
+// mailto:admin@metaspex.com
+//
+
+#ifndef EVENTS_ACCESS_CACHE_HPP
+#define EVENTS_ACCESS_CACHE_HPP
+
+#include <time.h>
+
+#include <map>
+#include <mutex>
+#include <utility>
+
+#include "hx2a/root.hpp"
+#include "hx2a/time.hpp"
+
+#include "events/misc.hpp"
+
+namespace events {
+
+  using namespace hx2a;
+
+  // Users known to have an invite or a booking for an event, so that private events authorization does not query the
+  // database each time.
+  // Only positive answers are cached. Entries are removed locally when an invite is declined or a booking canceled.
+  // Other workers keep theirs until they expire, which bounds the time a revoked access survives.
+  class access_cache
+  {
+  public:
+
+    bool contains(const doc_id& event_id, const doc_id& user_id){
+      ::std::lock_guard<::std::mutex> l(_mutex);
+      auto i = _entries.find({event_id, user_id});
+
+      if (i == _entries.end()){
+	return false;
+      }
+
+      if (time() - i->second >= time_t(get_access_cache_max_age())){
+	_entries.erase(i);
+	return false;
+      }
+
+      return true;
+    }
+
+    void insert(const doc_id& event_id, const doc_id& user_id){
+      ::std::lock_guard<::std::mutex> l(_mutex);
+
+      // Crude but bounded.
+      if (_entries.size() >= get_access_cache_limit()){
+	HX2A_LOG(trace) << "Access cache full, clearing it.";
+	_entries.clear();
+      }
+
+      _entries[{event_id, user_id}] = time();
+    }
+
+    void erase(const doc_id& event_id, const doc_id& user_id){
+      ::std::lock_guard<::std::mutex> l(_mutex);
+      _entries.erase({event_id, user_id});
+    }
+
+  private:
+
+    ::std::mutex _mutex;
+    // Value is the insertion time.
+    ::std::map<::std::pair<doc_id, doc_id>, time_t> _entries;
+  };
+
+  access_cache& get_access_cache();
+
+} // End namespace events.
+
+#endif
@@ -0,0 +1,145 @@
+//
+// Copyright Metaspex - 2024
+// mailto:admin@metaspex.com
+//
+
+#ifndef EVENTS_ADMISSION_HPP
+#define EVENTS_ADMISSION_HPP
+
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <utility>
+
+#include "hx2a/root.hpp"
+
+#include "events/misc.hpp"
+
+namespace events {
+
+  using namespace hx2a;
+
+  // Paces the bookings of each event, so that the opening of a popular event does not send all the bookings to the
+  // database at once.
+  // Users are admitted in the order they arrive, at the configured rate after an initial burst. Those who cannot be
+  // admitted yet get a slot and the time to wait for it. Coming back earlier does not lose the slot, coming back later
+  // than the grace period does.
+  // Per worker: the rate configured is the rate of each worker.
+  class admission_control
+  {
+  public:
+
+    // Returns the number of seconds to wait before coming back, null if the user can book now.
+    time_t admit(const doc_id& event_id, const doc_id& user_id){
+      ::std::lock_guard<::std::mutex> l(_mutex);
+      time_t w = wait(event_id, user_id);
+
+      if (!w){
+	_slots.erase({event_id, user_id});
+      }
+
+      return w;
+    }
+
+    // Same as admit, but keeps the slot for the booking to come.
+    time_t enqueue(const doc_id& event_id, const doc_id& user_id){
+      ::std::lock_guard<::std::mutex> l(_mutex);
+      return wait(event_id, user_id);
+    }
+
+  private:
+
+    using clock = ::std::chrono::steady_clock;
+    using seconds = ::std::chrono::duration<double>;
+
+    // Gives the user a slot if they do not have one yet.
+    time_t wait(const doc_id& event_id, const doc_id& user_id){
+      clock::time_point now = clock::now();
+      auto i = _slots.find({event_id, user_id});
+
+      if (i != _slots.end() && i->second <= grace_start(now)){
+	_slots.erase(i);
+	i = _slots.end();
+      }
+
+      if (i == _slots.end()){
+	if (_slots.size() >= get_admission_limit() || _next_slots.size() >= get_admission_limit()){
+	  evict(event_id, now);
+	}
+
+	clock::time_point t = next_slot(event_id, now);
+
+	// Only slots of other events to come.
+	if (_slots.size() >= get_admission_limit()){
+	  HX2A_LOG(trace) << "Admission control full, the slot is not kept.";
+	  return seconds_until(t, now);
+	}
+	
+	i = _slots.emplace(::std::pair{event_id, user_id}, t).first;
+      }
+
+      return seconds_until(i->second, now);
+    }
+
+    // Bounded. The slots which have come past the grace period go first, their users have not come back to book. Then,
+    // if needed, the slots of the event still to come, their users get new ones. The slots which have come and the slots
+    // of the other events are kept.
+    void evict(const doc_id& event_id, clock::time_point now){
+      clock::time_point g = grace_start(now);
+      ::std::erase_if(_slots, [g](const auto& s){ return s.second <= g; });
+      // A next slot which has come is the same as none.
+      ::std::erase_if(_next_slots, [now](const auto& n){ return n.second <= now; });
+
+      if (_slots.size() >= get_admission_limit()){
+	HX2A_LOG(trace) << "Admission control full, evicting the slots of event " << event_id << ".";
+	::std::erase_if(_slots, [&event_id, now](const auto& s){ return s.first.first == event_id && s.second > now; });
+      }
+
+      // The event whose next slot comes first loses its pacing.
+      while (_next_slots.size() >= get_admission_limit() && !_next_slots.empty()){
+	_next_slots.erase(::std::min_element(_next_slots.begin(), _next_slots.end(), [](const auto& a, const auto& b){ return a.second < b.second; }));
+      }
+    }
+
+    // The slots which came before are lost.
+    static clock::time_point grace_start(clock::time_point now){
+      return now - ::std::chrono::duration_cast<clock::duration>(seconds(double(get_admission_grace())));
+    }
+
+    static time_t seconds_until(clock::time_point t, clock::time_point now){
+      if (t <= now){
+	return 0;
+      }
+
+      // Rounded up.
+      return time_t(seconds(t - now).count()) + 1;
+    }
+
+    // Generic cell rate algorithm: the slots are spaced by the inverse of the rate, the burst ones are immediate.
+    clock::time_point next_slot(const doc_id& event_id, clock::time_point now){
+      HX2A_ASSERT(get_admission_rate());
+      auto interval = ::std::chrono::duration_cast<clock::duration>(seconds(1.0 / double(get_admission_rate())));
+      size_t burst = get_admission_burst();
+      auto tolerance = interval * (burst ? burst - 1 : 0);
+      clock::time_point& n = _next_slots[event_id];
+      n = ::std::max(n, now);
+      clock::time_point r = ::std::max(n - tolerance, now);
+      n += interval;
+      return r;
+    }
+
+    ::std::mutex _mutex;
+    // Keys are the event and the user.
+    ::std::map<::std::pair<doc_id, doc_id>, clock::time_point> _slots;
+    // Per event, the theoretical time of the next slot, ignoring the burst.
+    ::std::map<doc_id, clock::time_point> _next_slots;
+  };
+
+  admission_control& get_admission_control();
+
+} // End namespace events.
+
+#endif
@@ -0,0 +1,100 @@
+//
+// Copyright Metaspex - 2024
+// mailto:admin@metaspex.com
+//
+
+#ifndef EVENTS_BLOOM_HPP
+#define EVENTS_BLOOM_HPP
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "hx2a/root.hpp"
+
+#include "events/hash.hpp"
+
+namespace events {
+
+  using namespace hx2a;
+
+  // Fixed size Bloom filter of document identifiers, stored in documents as a vector of words.
+  // A negative answer is certain, a positive one is not. Identifiers cannot be removed, removals leave false positives
+  // behind, which only cost the lookup the filter would have avoided.
+  // 32-bit words so that they survive JSON numbers unchanged.
+  class bloom_filter
+  {
+  public:
+
+    using word_t = uint32_t;
+    using words_type = ::std::vector<word_t>;
+
+    static constexpr size_t words_count = 64;
+    static constexpr size_t bits_count = words_count * 32;
+    // With 2048 bits and 3 hashes, the false positive rate stays under 5% up to about 300 identifiers.
+    static constexpr size_t hashes_count = 3;
+
+    // Empty filter.
+    bloom_filter():
+      _words(words_count, 0)
+    {
+    }
+
+    // From stored words. Anything not of the expected size is unknown, e.g., not stored yet.
+    template <typename Iterator>
+    bloom_filter(Iterator b, Iterator e):
+      _words(b, e)
+    {
+    }
+
+    // An unknown filter cannot answer, it must be rebuilt.
+    bool is_unknown() const { return _words.size() != words_count; }
+
+    bool may_contain(const doc_id& id) const {
+      if (is_unknown()){
+	return true;
+      }
+
+      bool r = true;
+
+      for_each_bit(id, [&](size_t w, word_t m){
+	if (!(_words[w] & m)){
+	  r = false;
+	}
+      });
+
+      return r;
+    }
+
+    void add(const doc_id& id){
+      HX2A_ASSERT(!is_unknown());
+
+      for_each_bit(id, [&](size_t w, word_t m){
+	_words[w] |= m;
+      });
+    }
+
+    const words_type& get_words() const { return _words; }
+
+  private:
+
+    // Double hashing from a single 64-bit hash.
+    template <typename F>
+    static void for_each_bit(const doc_id& id, F f){
+      uint64_t h = hasher().add_printable(id).get();
+      uint64_t h1 = h & 0xffffffff;
+      // Odd so that all the hashes differ.
+      uint64_t h2 = (h >> 32) | 1;
+
+      for (size_t i = 0; i != hashes_count; ++i){
+	size_t b = (h1 + i * h2) % bits_count;
+	f(b / 32, word_t(1) << (b % 32));
+      }
+    }
+
+    words_type _words;
+  };
+
+} // End namespace events.
+
+#endif
@@ -6,16 +6,22 @@
 #ifndef EVENTS_CLIENT_STATE_HPP
 #define EVENTS_CLIENT_STATE_HPP
 
+#include <set>
+#include <vector>
+
 #include "hx2a/cursor.hpp"
 #include "hx2a/for_each_doc.hpp"
 #include "hx2a/own.hpp"
 #include "hx2a/root.hpp"
 #include "hx2a/slot.hpp"
+#include "hx2a/time.hpp"
 
 #include "hx2a/components/user.hpp"
 
 #include "messenger/client_state.hpp"
 
+#include "events/doc_ids.hpp"
+#include "events/hash.hpp"
 #include "events/misc.hpp"
 #include "events/tags.hpp"
 
@@ -25,20 +31,30 @@ namespace events {
   using client_state_p = ptr<client_state>;
   using client_state_r = rfr<client_state>;
 
+  class app_token_session;
+  using app_token_session_p = ptr<app_token_session>;
+  using app_token_session_r = rfr<app_token_session>;
+
   // The App token is stored in the Messenger client state App token.
   // The client state is retrieved from the user link, and then the token is found on the client
   // state document.
+  // A session started with a token replaces the client state of the previous session with the same token, found through
+  // the token's session, see app_token_session. The sweep service removes the client states not seen for a long time.
   class client_state: public root<>
   {
     HX2A_ROOT(client_state, type_tag<"client_state">, 1, root,
 	      ((_user, "u"),
-	       (_messenger_client_state, "m")));
+	       (_messenger_client_state, "m"),
+	       (_last_seen_day, "lsd")));
 
   public:
 
+    static constexpr time_t seconds_per_day = 24 * 60 * 60;
+
     client_state(const user_r& u, const string& token):
       _user(*this, u),
-      _messenger_client_state(*this)
+      _messenger_client_state(*this),
+      _last_seen_day(*this, today())
     {
       set_app_token(token);
     }
@@ -67,25 +83,58 @@ namespace events {
       return (*mcs)->get_app_token();
     }
 
-    // Cleaning up zombie client state documents (e.g., if a user has logged in without properly logged out).
-    static void clean_up(const db::connector& cn, const user_r& u, const string& token){
-      // By batches of 100. Unlikely it's more than one.
-      cursor c = cursor_on_key<client_state>(cn->get_index(index_by_token), {.key = {token}, .limit = 100});
-      
-      for_each_doc(c, [&u, &token](const client_state_r& cs){
-	HX2A_LOG(trace) << "While creating a client state for user " << u->get_id() << ", found leftover client state for user " << cs->get_user()->get_id() << " and token \"" << token << "\". Removing it.";
-	cs->unpublish();
-      });
+    // Null for client states created before it was recorded.
+    time_t get_last_seen_day() const { return _last_seen_day; }
+
+    // Creates the client state of a new session. It replaces the one of the previous session with the same token,
+    // possibly of another user if the device changed hands.
+    static client_state_r create(const db::connector&, const user_r&, const string& token);
+
+    // Removes it, and its token's session if it is the current one.
+    void remove(const db::connector&);
+
+    // Whether it is the client state of the latest session started with its token. The client states created before the
+    // token sessions were recorded have none and are deemed current until the sweep records one.
+    bool is_current(const db::connector&) const;
+
+    // Records that the client state is in use. Writes at most once a day.
+    void touch(){
+      time_t d = today();
+
+      if (_last_seen_day != d){
+	_last_seen_day = d;
+      }
     }
 
+    // Removes the client states not seen for the maximum idle time. Goes back the configured number of days before
+    // that, the sweep must run more often than that.
+    // Also removes the client states seen over the same number of days which are not the current one of their token,
+    // and records the token's session of the ones created before the token sessions were. Returns the number of client
+    // states removed.
+    static size_t sweep(const db::connector&);
+
     // Indexes.
 
     constexpr static tag_t index_by_user = config_name<"cs_u">;
     
+    // Only to record the token sessions of the client states created before them. Can be dropped afterwards.
     constexpr static tag_t index_by_token = config_name<"cs_t">;
+
+    constexpr static tag_t index_by_last_seen_day = config_name<"cs_lsd">;
     
   private:
 
+    static time_t today(){ return time() / seconds_per_day; }
+
+    // Keeps the client state of the token seen most recently, and records it as the token's session. Returns the number
+    // of client states removed.
+    static size_t remove_superseded(const db::connector&, const string& token);
+
+    bool is_more_recent_than(const client_state_r& cs) const {
+      return _last_seen_day > cs->get_last_seen_day() ||
+	(_last_seen_day == cs->get_last_seen_day() && get_creation_time() > cs->get_creation_time());
+    }
+
     void set_app_token(const string& token){
       messenger::client_state_p mcs = _messenger_client_state;
 
@@ -101,8 +150,162 @@ namespace events {
 
     link<user> _user;
     own<messenger::client_state> _messenger_client_state;
+    // In days since the epoch, so that the document is written at most once a day.
+    slot<time_t> _last_seen_day;
+  };
+
+  // The client state of the latest session started with an App token, so that the client states of a token are found,
+  // replaced and cleaned up with single key operations.
+  class app_token_session: public root<>
+  {
+    HX2A_ROOT(app_token_session, type_tag<"app_token_session">, 1, root,
+	      ((_client_state_id, "cs")));
+
+  public:
+
+    app_token_session(const doc_id& client_state_id):
+      _client_state_id(*this, client_state_id)
+    {
+    }
+
+    // The derived identifier of the session of a token, see doc_ids.hpp. Hashed as tokens are long and contain
+    // characters unsuitable for identifiers.
+    static doc_id make_id(const string& token){
+      return derived_doc_id("ats", hasher().add(token).str());
+    }
+
+    static app_token_session_p get(const db::connector& cn, const string& token){
+      return root_get<app_token_session>(cn, make_id(token));
+    }
+
+    doc_id get_client_state_id() const { return _client_state_id; }
+
+    void set_client_state_id(const doc_id& id){ _client_state_id = id; }
+
+  private:
+
+    slot<doc_id> _client_state_id;
   };
+
+  inline client_state_r client_state::create(const db::connector& cn, const user_r& u, const string& token){
+    client_state_r cs = make<client_state>(cn, u, token);
+
+    if (app_token_session_p ats = app_token_session::get(cn, token)){
+      doc_id previous = (*ats)->get_client_state_id();
+
+      if (client_state_p p = root_get<client_state>(cn, previous)){
+	HX2A_LOG(trace) << "While creating a client state for user " << u->get_id() << ", replacing client state " << previous << " of user " << (*p)->get_user()->get_id() << " for the same token.";
+	(*p)->unpublish();
+      }
+
+      (*ats)->set_client_state_id(cs->get_id());
+    }
+    else{
+      make_derived<app_token_session>(cn, app_token_session::make_id(token), cs->get_id());
+    }
+
+    return cs;
+  }
+
+  inline void client_state::remove(const db::connector& cn){
+    if (string token = get_app_token(); !token.empty()){
+      if (app_token_session_p ats = app_token_session::get(cn, token); ats && (*ats)->get_client_state_id() == get_id()){
+	(*ats)->unpublish();
+      }
+    }
+
+    unpublish();
+  }
+
+  inline bool client_state::is_current(const db::connector& cn) const {
+    string token = get_app_token();
+
+    if (token.empty()){
+      return true;
+    }
+
+    app_token_session_p ats = app_token_session::get(cn, token);
+    return !ats || (*ats)->get_client_state_id() == get_id();
+  }
+
+  inline size_t client_state::sweep(const db::connector& cn){
+    time_t last = today() - time_t(get_client_state_max_idle()) / seconds_per_day;
+    size_t n = 0;
+
+    for (time_t d = last - time_t(get_client_state_sweep_days()); d <= last; ++d){
+      // Client states created before the last seen day was recorded have a null day and are not swept.
+      if (d <= 0){
+	continue;
+      }
+      
+      // By batches of 100.
+      cursor c = cursor_on_key<client_state>(cn->get_index(index_by_last_seen_day), {.key = {d}, .limit = 100});
+
+      for_each_doc(c, [&cn, &n](const client_state_r& cs){
+	HX2A_LOG(trace) << "Removing client state " << cs->get_id() << " for user " << cs->get_user()->get_id() << ", not seen for too long.";
+	cs->remove(cn);
+	++n;
+      });
+    }
+
+    // Each token without a session once.
+    ::std::set<string> tokens;
+    time_t t = today();
     
+    for (time_t d = t - time_t(get_client_state_sweep_days()); d <= t; ++d){
+      // By batches of 100.
+      cursor c = cursor_on_key<client_state>(cn->get_index(index_by_last_seen_day), {.key = {d}, .limit = 100});
+
+      for_each_doc(c, [&cn, &n, &tokens](const client_state_r& cs){
+	if (!cs->is_current(cn)){
+	  HX2A_LOG(trace) << "Removing client state " << cs->get_id() << " for user " << cs->get_user()->get_id() << ", superseded by a more recent session for the same token.";
+	  cs->remove(cn);
+	  ++n;
+	  return;
+	}
+	
+	string token = cs->get_app_token();
+
+	if (!token.empty() && tokens.insert(token).second && !app_token_session::get(cn, token)){
+	  n += remove_superseded(cn, token);
+	}
+      });
+    }
+    
+    return n;
+  }
+
+  inline size_t client_state::remove_superseded(const db::connector& cn, const string& token){
+    client_state_p latest;
+    ::std::vector<client_state_r> others;
+    // By batches of 100. Unlikely it's more than one.
+    cursor c = cursor_on_key<client_state>(cn->get_index(index_by_token), {.key = {token}, .limit = 100});
+
+    for_each_doc(c, [&latest, &others](const client_state_r& cs){
+      if (!latest){
+	latest = cs;
+      }
+      else if (cs->is_more_recent_than(*latest)){
+	others.push_back(*latest);
+	latest = cs;
+      }
+      else{
+	others.push_back(cs);
+      }
+    });
+
+    for (const client_state_r& cs: others){
+      HX2A_LOG(trace) << "Removing client state " << cs->get_id() << " for user " << cs->get_user()->get_id() << ", superseded by a more recent one for the same token.";
+      cs->unpublish();
+    }
+
+    if (latest){
+      make_derived<app_token_session>(cn, app_token_session::make_id(token), (*latest)->get_id());
+    }
+
+    return others.size();
+  }
+
 } // End namespace events.
 
 #endif
@@ -0,0 +1,51 @@
+//
+// Copyright Metaspex - 2024
+// mailto:admin@metaspex.com
+//
+
+#ifndef EVENTS_DOC_IDS_HPP
+#define EVENTS_DOC_IDS_HPP
+
+#include <sstream>
+
+#include "hx2a/root.hpp"
+
+namespace events {
+
+  using namespace hx2a;
+
+  // Content-derived document identifiers.
+  // Some documents are unique for a combination of other documents, e.g., one booking per event and guest. Deriving
+  // their identifier from that combination turns the existence check into a single document get instead of an index
+  // query, and concurrent duplicate creations fail on insertion, as the store refuses a second document with the same
+  // identifier.
+  // The prefix distinguishes the document types. The components are separated so that different combinations cannot
+  // produce the same identifier.
+  template <typename... Components>
+  doc_id derived_doc_id(const char* prefix, const Components&... cs){
+    ostringstream os;
+    os << prefix;
+    ((os << ':' << cs), ...);
+    return doc_id{os.str()};
+  }
+
+  // Creates the document with the supplied identifier. The arguments are the ones make takes after the connector.
+  // Callers check for existence first to report a meaningful exception in the non-concurrent case.
+  // The single place relying on the store creating a document with an identifier supplied by the caller. Nothing else
+  // in the application uses make_with_id, its contract is assumed, not shown by this tree:
+  // - the document gets the supplied identifier instead of a generated one;
+  // - it is saved with an insertion, not an upsert, so that the save of a second document with the same identifier
+  //   fails when the service completes (Couchbase refuses the insertion of an existing key, MongoDB raises a duplicate
+  //   key error on _id), failing that service.
+  // If the saves turn out to be upserts, derived identifiers still give single get lookups, but concurrent creations
+  // overwrite each other instead of failing. The options creating derived documents are off by default until that is
+  // checked against the HX2A version deployed. The token sessions are always derived, an overwrite only loses the
+  // replacement of a client state, which the sweep catches up with.
+  template <typename T, typename... Args>
+  rfr<T> make_derived(const db::connector& cn, const doc_id& id, Args&&... args){
+    return make_with_id<T>(cn, id, ::std::forward<Args>(args)...);
+  }
+
+} // End namespace events.
+
+#endif
@@ -0,0 +1,123 @@
+//
+// Copyright Metaspex - 2024
+// mailto:admin@metaspex.com
+//
+
+#ifndef EVENTS_ETAG_HPP
+#define EVENTS_ETAG_HPP
+
+#include "events/hash.hpp"
+#include "events/ontology.hpp"
+
+namespace events {
+
+  // Entity tags for conditional gets.
+  // A client supplies the tag of the copy it has, and gets an empty reply (JSON object {}) if nothing changed. The tag
+  // hashes the values a payload is calculated from, so that checking it only costs document gets and no payload is
+  // built. Save timestamps would not do, they have a one second resolution and two updates within the same second
+  // would have the same tag. Values which change without any save, such as an event ceasing to be bookable when its
+  // window starts, are hashed too.
+  // To be kept in line with the payloads.
+  class etag
+  {
+  public:
+
+    // For venue_data_payload.
+    etag(const venue_r& v){ add(v); }
+
+    // For event_data_payload.
+    etag(const event_r& e){ add(e); }
+
+    // For booking_and_event_data_payload.
+    etag(const booking_r& b){
+      if (user_p h = b->get_host()){
+	add(*h);
+      }
+      else{
+	_h.add(uint64_t(0));
+      }
+
+      add(b->get_guest());
+      _h.add(b->get_note());
+      _h.add(uint64_t(b->get_creation_time()));
+      _h.add(uint64_t(b->get_save_time()));
+      _h.add(uint64_t(b->get_check_in_timestamp()));
+      add(b->get_event());
+    }
+
+    string str() const { return _h.str(); }
+
+    // Comparing with the tag supplied by a client.
+    bool operator==(const string& s) const { return !s.empty() && s == str(); }
+
+  private:
+
+    void add(const user_r& u){
+      _h.add_printable(u->get_id());
+      _h.add_printable(u->get_user_id());
+      _h.add_printable(u->get_forename());
+      _h.add_printable(u->get_lastname());
+      _h.add_printable(u->get_email());
+      _h.add_printable(u->get_alternate_email());
+    }
+
+    template <typename Images>
+    void add_images(const Images& im){
+      _h.add(uint64_t(im.size()));
+
+      for (const auto& i: im){
+	_h.add(i.get());
+      }
+    }
+
+    void add(const venue_r& v){
+      _h.add_printable(v->get_id());
+      // Covers the address.
+      _h.add(v->get_revision());
+      _h.add(v->get_name());
+      _h.add(uint64_t(v->is_private()));
+      _h.add(uint64_t(v->get_category()));
+      _h.add(v->get_category_description());
+      position_r p = v->get_position();
+      _h.add_double(double(p->get_latitude()));
+      _h.add_double(double(p->get_longitude()));
+      _h.add(uint64_t(v->get_capacity()));
+      _h.add(v->get_description());
+      _h.add(uint64_t(v->get_event_confirmation_required()));
+      add_images(v->get_images());
+      _h.add_double(v->get_rating());
+      add(v->get_owner());
+    }
+
+    void add(const event_r& e){
+      _h.add_printable(e->get_id());
+      _h.add(e->get_name());
+      _h.add(uint64_t(e->is_private()));
+      _h.add(uint64_t(e->get_category()));
+      _h.add(e->get_category_description());
+      _h.add(uint64_t(e->get_capacity()));
+      _h.add(uint64_t(e->get_start()));
+      _h.add(uint64_t(e->get_duration()));
+      _h.add(uint64_t(e->get_bookings_notice_time()));
+      add_images(e->get_images());
+      _h.add(uint64_t(e->get_state()));
+      _h.add(uint64_t(e->is_bookable()));
+      add(e->get_organizer());
+      add(e->get_venue());
+
+      // The organizer display name comes from the conversation.
+      if (messenger::conversation_p conv = e->get_conversation()){
+	_h.add_printable((*conv)->get_id());
+	_h.add(e->get_organizer_display_name());
+      }
+      else{
+	_h.add(uint64_t(0));
+      }
+    }
+
+    hasher _h;
+  };
+
+} // End namespace events.
+
+#endif
@@ -33,6 +33,7 @@ namespace events {
   using client_state_already_exists = exception<"csexists", "Client state already exists.">;
   
   using contacts_in_open_invite_limit_reached = exception<"contil", "Contacts in open invite limit reached.">;
+  using too_many_contacts = exception<"contmany", "Too many contacts.">;
   
   using event_cannot_be_checked_in = exception<"ecnotci", "Event cannot be checked in.">;
   using event_does_not_exist = exception<"emiss", "Event does not exist.">;
@@ -41,12 +42,14 @@ namespace events {
   using event_is_not_bookable = exception<"enbook", "Event is not bookable.">;
   using event_is_rejected = exception<"erej", "Event is rejected.">;
   using event_organizer_display_name_missing = exception<"eodnmiss", "Event organizer display name is missing.">;
+  using guests_filter_unavailable = exception<"egfunav", "Guests filter unavailable for the event.">;
   
   using insufficient_capacity = exception<"inscap", "Insufficient capacity.">;
   using invalid_capacity = exception<"invcap", "Invalid capacity.">;
   
   using invite_already_made = exception<"invmade", "Invite already made.">;
   using invite_does_not_exist = exception<"invmiss", "Invite does not exist.">;
+  using too_many_guests = exception<"invmany", "Too many guests.">;
   
   using news_does_not_exist = exception<"nmiss", "The news does not exist.">;
   using news_expiry_in_the_past = exception<"nexpast", "The news expiry time is in the past.">;
@@ -54,6 +57,8 @@ namespace events {
   
   using position_missing = exception<"pmiss", "Position is missing.">;
   
+  using resync_required = exception<"resync", "Full synchronization required.">;
+  
   using too_late = exception<"late", "Too late to perform operation.">;
   
   using events_organization_does_not_exist = exception<"vdne", "The organization named \"events\" does not exist.">;
@@ -0,0 +1,84 @@
+//
+// Copyright Metaspex - 2024
+// mailto:admin@metaspex.com
+//
+
+#ifndef EVENTS_HASH_HPP
+#define EVENTS_HASH_HPP
+
+#include <stdint.h>
+#include <string.h>
+
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+namespace events {
+
+  // 64-bit FNV-1a. Not cryptographic. Used where a compact, stable hash of a few values is needed (entity tags,
+  // filters, buckets). Stable across processes and versions, so hashes can be stored or handed to clients.
+  class hasher
+  {
+  public:
+
+    hasher& add(const void* p, size_t n){
+      const unsigned char* b = static_cast<const unsigned char*>(p);
+
+      for (size_t i = 0; i != n; ++i){
+	_h ^= b[i];
+	_h *= prime;
+      }
+
+      return *this;
+    }
+
+    // Byte by byte so that the result does not depend on endianness.
+    hasher& add(uint64_t v){
+      for (size_t i = 0; i != sizeof(v); ++i){
+	unsigned char b = (unsigned char)(v >> (8 * i));
+	add(&b, 1);
+      }
+
+      return *this;
+    }
+
+    // By bit pattern.
+    hasher& add_double(double v){
+      uint64_t b;
+      memcpy(&b, &v, sizeof(b));
+      return add(b);
+    }
+
+    hasher& add(const ::std::string& s){
+      add(s.size());
+      return add(s.data(), s.size());
+    }
+
+    // Anything streamable, document identifiers for instance.
+    template <typename T>
+    hasher& add_printable(const T& t){
+      ::std::ostringstream os;
+      os << t;
+      return add(os.str());
+    }
+
+    uint64_t get() const { return _h; }
+
+    // 16 hexadecimal digits.
+    ::std::string str() const {
+      ::std::ostringstream os;
+      os << ::std::hex << ::std::setw(16) << ::std::setfill('0') << _h;
+      return os.str();
+    }
+
+  private:
+
+    static constexpr uint64_t offset_basis = 14695981039346656037ull;
+    static constexpr uint64_t prime = 1099511628211ull;
+
+    uint64_t _h = offset_basis;
+  };
+
+} // End namespace events.
+
+#endif
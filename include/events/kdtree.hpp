@@ -11,6 +11,8 @@
 
 #include <time.h>
 
+#include <vector>
+
 #include "hx2a/kdcache.hpp"
 #include "hx2a/db/connector.hpp"
 
@@ -62,6 +64,45 @@ namespace events {
   
   cached_events_type& get_cached_events(const db::connector& cn);
 
+  // Scratch space for kdcache search results.
+  // A search needs a vector as large as the search limit to receive the documents found. Instead of allocating one per
+  // request, each thread keeps one and reuses it from one request to the next. All the document references it holds are
+  // released in one go when the request is done with it, the memory is kept.
+  // Not reentrant, a thread must not hold two scratches of the same type at the same time.
+  template <typename Doc>
+  class search_scratch
+  {
+  public:
+
+    using vector_type = ::std::vector<ptr<Doc>>;
+
+    search_scratch(size_t size):
+      _v(buffer())
+    {
+      HX2A_ASSERT(_v.empty());
+      _v.resize(size);
+    }
+
+    search_scratch(const search_scratch&) = delete;
+
+    search_scratch& operator=(const search_scratch&) = delete;
+    
+    ~search_scratch(){
+      _v.clear();
+    }
+
+    vector_type& get(){ return _v; }
+
+  private:
+
+    static vector_type& buffer(){
+      thread_local vector_type v;
+      return v;
+    }
+
+    vector_type& _v;
+  };
+
 } // End namespace events.
 
 #endif
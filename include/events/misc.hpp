@@ -6,6 +6,8 @@
 #ifndef EVENTS_MISC_HPP
 #define EVENTS_MISC_HPP
 
+#include <time.h>
+
 #include "hx2a/tag_type.hpp"
 
 namespace events {
@@ -42,9 +44,161 @@ namespace events {
   constexpr size_t default_venues_search_limit = 100;
   size_t get_venues_search_limit();
   
+  // Bookings with identifiers derived from their event and guest, see doc_ids.hpp.
+  // Timestamp from which bookings get derived identifiers. Events created before can still have bookings with random
+  // identifiers, looking them up falls back to the index. Null means disabled.
+  constexpr tag_t derived_booking_ids_since_name = config_name<"derived_booking_ids_since">;
+  constexpr time_t default_derived_booking_ids_since = 0;
+  time_t get_derived_booking_ids_since();
+
+  // Private events authorization cache, see access_cache.hpp.
+  constexpr tag_t access_cache_max_age_name = config_name<"access_cache_max_age">;
+  // In seconds. Bounds the time a revoked access survives on other workers.
+  constexpr size_t default_access_cache_max_age = 60;
+  size_t get_access_cache_max_age();
+
+  constexpr tag_t access_cache_limit_name = config_name<"access_cache_limit">;
+  // In number of event and user pairs.
+  constexpr size_t default_access_cache_limit = 100000;
+  size_t get_access_cache_limit();
+
+  // Same for invites.
+  constexpr tag_t derived_invite_ids_since_name = config_name<"derived_invite_ids_since">;
+  constexpr time_t default_derived_invite_ids_since = 0;
+  time_t get_derived_invite_ids_since();
+
   constexpr tag_t contacts_in_open_invite_limit_name = config_name<"contacts_in_open_invite_limit">;
   constexpr size_t default_contacts_in_open_invite_limit = 16;
   size_t get_contacts_in_open_invite_limit();
+
+  // Contacts beyond the ones held inline by the open invite document, stored in their own documents.
+  // Null means that open invites hold their contacts inline only.
+  constexpr tag_t stored_contacts_in_open_invite_limit_name = config_name<"stored_contacts_in_open_invite_limit">;
+  constexpr size_t default_stored_contacts_in_open_invite_limit = 0;
+  size_t get_stored_contacts_in_open_invite_limit();
+
+  constexpr tag_t contacts_in_bulk_limit_name = config_name<"contacts_in_bulk_limit">;
+  // In number of contacts per call.
+  constexpr size_t default_contacts_in_bulk_limit = 1000;
+  size_t get_contacts_in_bulk_limit();
+
+  constexpr tag_t invites_in_bulk_limit_name = config_name<"invites_in_bulk_limit">;
+  // In number of guests per call.
+  constexpr size_t default_invites_in_bulk_limit = 100;
+  size_t get_invites_in_bulk_limit();
+
+  // Number of booking counter documents of new events, see event::shard_bookings. Null means that the booking count
+  // is on the event document.
+  constexpr tag_t booking_shards_name = config_name<"booking_shards">;
+  constexpr size_t default_booking_shards = 0;
+  size_t get_booking_shards();
+
+  constexpr tag_t booking_counts_max_age_name = config_name<"booking_counts_max_age">;
+  // In seconds. How long the sum of sharded booking counters is cached.
+  constexpr size_t default_booking_counts_max_age = 5;
+  size_t get_booking_counts_max_age();
+
+  constexpr tag_t booking_counts_cache_limit_name = config_name<"booking_counts_cache_limit">;
+  // In number of events.
+  constexpr size_t default_booking_counts_cache_limit = 100000;
+  size_t get_booking_counts_cache_limit();
+
+  // Seat documents for the new events with a finite capacity, see the seat document. Null means that capacity relies on
+  // the booking count alone.
+  constexpr tag_t seat_documents_name = config_name<"seat_documents">;
+  constexpr size_t default_seat_documents = 0;
+  bool get_seat_documents();
+
+  constexpr tag_t seat_probes_limit_name = config_name<"seat_probes_limit">;
+  // In number of seats read to find a free one. Past it the event is deemed full, only when nearly all seats are taken.
+  constexpr size_t default_seat_probes_limit = 1000;
+  size_t get_seat_probes_limit();
+
+  // Seat holds, see the seat_hold document.
+  constexpr tag_t seat_hold_duration_name = config_name<"seat_hold_duration">;
+  // In seconds.
+  constexpr size_t default_seat_hold_duration = 300;
+  size_t get_seat_hold_duration();
+
+  constexpr tag_t seat_holds_sweep_minutes_name = config_name<"seat_holds_sweep_minutes">;
+  // In minutes. The holds the sweep misses are given back when their event is found full.
+  constexpr size_t default_seat_holds_sweep_minutes = 60;
+  size_t get_seat_holds_sweep_minutes();
+
+  // Bookings admission control, see admission.hpp.
+  // Null means that bookings are not paced.
+  constexpr tag_t admission_rate_name = config_name<"admission_rate">;
+  // In bookings per second, per event and per worker.
+  constexpr size_t default_admission_rate = 0;
+  size_t get_admission_rate();
+
+  constexpr tag_t admission_burst_name = config_name<"admission_burst">;
+  // In bookings admitted at once before pacing starts.
+  constexpr size_t default_admission_burst = 20;
+  size_t get_admission_burst();
+
+  constexpr tag_t admission_limit_name = config_name<"admission_limit">;
+  // In number of users waiting, all events together.
+  constexpr size_t default_admission_limit = 100000;
+  size_t get_admission_limit();
+
+  constexpr tag_t admission_grace_name = config_name<"admission_grace">;
+  // In seconds. How long a slot which has come is kept for its user to come back and book.
+  constexpr size_t default_admission_grace = 60;
+  size_t get_admission_grace();
+
+  // Notifications outbox, see the notification document.
+  // Null means that notifications are sent immediately by the services.
+  constexpr tag_t notifications_outbox_name = config_name<"notifications_outbox">;
+  constexpr size_t default_notifications_outbox = 0;
+  bool get_notifications_outbox();
+
+  constexpr tag_t notifications_drain_limit_name = config_name<"notifications_drain_limit">;
+  // In number of notifications per drain.
+  constexpr size_t default_notifications_drain_limit = 100;
+  size_t get_notifications_drain_limit();
+
+  constexpr tag_t notification_retry_delay_name = config_name<"notification_retry_delay">;
+  // In seconds. Doubled at each attempt.
+  constexpr size_t default_notification_retry_delay = 60;
+  size_t get_notification_retry_delay();
+
+  constexpr tag_t notification_max_attempts_name = config_name<"notification_max_attempts">;
+  constexpr size_t default_notification_max_attempts = 8;
+  size_t get_notification_max_attempts();
+
+  constexpr tag_t notification_lease_name = config_name<"notification_lease">;
+  // In seconds. The drain must run more often than that.
+  constexpr size_t default_notification_lease = 300;
+  size_t get_notification_lease();
+
+  constexpr tag_t notifications_drain_lookback_name = config_name<"notifications_drain_lookback">;
+  // In minutes. How far back the very first drain looks for due notifications, and how many minutes a drain reads at
+  // most, so that a drain after a long outage is bounded. The drains after catch up.
+  constexpr size_t default_notifications_drain_lookback = 60;
+  size_t get_notifications_drain_lookback();
+
+  // Client states not seen for that long are removed by the sweep service, see client_state.hpp.
+  constexpr tag_t client_state_max_idle_name = config_name<"client_state_max_idle">;
+  // In seconds, 90 days.
+  constexpr size_t default_client_state_max_idle = 90 * 24 * 60 * 60;
+  size_t get_client_state_max_idle();
+
+  constexpr tag_t client_state_sweep_days_name = config_name<"client_state_sweep_days">;
+  // In days. The sweep must run more often than that.
+  constexpr size_t default_client_state_sweep_days = 30;
+  size_t get_client_state_sweep_days();
+
+  // Removals older than that are removed by the sweep service, see the removal document.
+  constexpr tag_t removal_retention_name = config_name<"removal_retention">;
+  // In seconds, 30 days.
+  constexpr size_t default_removal_retention = 30 * 24 * 60 * 60;
+  size_t get_removal_retention();
+
+  constexpr tag_t removal_sweep_days_name = config_name<"removal_sweep_days">;
+  // In days. The sweep must run more often than that.
+  constexpr size_t default_removal_sweep_days = 30;
+  size_t get_removal_sweep_days();
   
 } // End namespace events.
 
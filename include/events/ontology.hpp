@@ -20,8 +20,12 @@
 
 #include "messenger/ontology.hpp"
 
+#include "events/access_cache.hpp"
+#include "events/bloom.hpp"
+#include "events/doc_ids.hpp"
 #include "events/exception.hpp"
 #include "events/misc.hpp"
+#include "events/push.hpp"
 #include "events/tags.hpp"
 
 namespace events {
@@ -48,6 +52,10 @@ namespace events {
   using open_invite_p = ptr<open_invite>;
   using open_invite_r = rfr<open_invite>;
   
+  class open_invite_contact;
+  using open_invite_contact_p = ptr<open_invite_contact>;
+  using open_invite_contact_r = rfr<open_invite_contact>;
+  
   class invite;
   using invite_p = ptr<invite>;
   using invite_r = rfr<invite>;
@@ -60,6 +68,34 @@ namespace events {
   using news_p = ptr<news>;
   using news_r = rfr<news>;
 
+  class removal;
+  using removal_p = ptr<removal>;
+  using removal_r = rfr<removal>;
+
+  class agenda_item;
+  using agenda_item_p = ptr<agenda_item>;
+  using agenda_item_r = rfr<agenda_item>;
+
+  class notification;
+  using notification_p = ptr<notification>;
+  using notification_r = rfr<notification>;
+
+  class notifications_drain_mark;
+  using notifications_drain_mark_p = ptr<notifications_drain_mark>;
+  using notifications_drain_mark_r = rfr<notifications_drain_mark>;
+
+  class booking_counter;
+  using booking_counter_p = ptr<booking_counter>;
+  using booking_counter_r = rfr<booking_counter>;
+
+  class seat_hold;
+  using seat_hold_p = ptr<seat_hold>;
+  using seat_hold_r = rfr<seat_hold>;
+
+  class seat;
+  using seat_p = ptr<seat>;
+  using seat_r = rfr<seat>;
+
   // Strongly-typed capacity for safety.
   enum capacity_t: unsigned int {};
   // A null capacity means infinite capacity.
@@ -121,7 +157,8 @@ namespace events {
 	       (_description, "d"),
 	       (_event_confirmation_required, "ecr"),
 	       (_images, "i"),
-	       (_rating, "r")));
+	       (_rating, "r"),
+	       (_revision, "rev")));
   public:
 
     using images_type = slot_vector<string>;
@@ -156,7 +193,8 @@ namespace events {
       _description(*this, desc),
       _event_confirmation_required(*this, event_confirmation_required),
       _images(*this),
-      _rating(*this, rating)
+      _rating(*this, rating),
+      _revision(*this, 0)
     {
     }
 
@@ -166,7 +204,10 @@ namespace events {
       return make<venue_claim>(cn, u, *this);
     }
 
-    void transfer(const user_r& new_owner){ _owner = new_owner; }
+    void transfer(const user_r& new_owner){
+      _owner = new_owner;
+      revise();
+    }
 
     const string& get_name() const { return _name; }
 
@@ -200,6 +241,7 @@ namespace events {
 
     void set_rating(rating_t r){
       _rating = r;
+      revise();
     }
 
     // Beware when updating capacity, there might be events already organized. The caller takes care of that.
@@ -213,6 +255,7 @@ namespace events {
       _description = desc;
       _event_confirmation_required = event_confirmation_required;
       _rating = rating;
+      revise();
     }
 
     template <typename ImagesHolder>
@@ -222,8 +265,13 @@ namespace events {
       for (const auto& i: ih->images){
 	push_image_back(i.get());
       }
+
+      revise();
     }
 
+    // Incremented by the updates. Entity tags hash it, as the address cannot be hashed.
+    uint64_t get_revision() const { return _revision; }
+
     // Indexes.
 
     static constexpr tag_t index_by_save_timestamp = config_name<"v_c">;
@@ -232,6 +280,8 @@ namespace events {
 
   private:
 
+    void revise(){ _revision = _revision + 1; }
+
     // If the user is removed, all the corresponding venues are removed too.
     link<user> _owner;
     slot<string> _name;
@@ -248,6 +298,7 @@ namespace events {
     // Storing only the URLs.
     images_type _images;
     slot<rating_t> _rating;
+    slot<uint64_t> _revision;
   };
 
   // The organizer is not necessarily a guest. He'll need to book the event to be a guest.
@@ -269,12 +320,16 @@ namespace events {
 	       (_bookings_notice_time, "bnt"),
 	       (_bookings_count, "bc"),
 	       (_images, "i"),
-	       (_report_count, "rc")));
+	       (_report_count, "rc"),
+	       (_guests_filter, "gf"),
+	       (_booking_shards, "bs"),
+	       (_seat_documents, "sd")));
   public:
 
     using images_type = slot_vector<string>;
     using images_const_iterator = images_type::const_iterator;
     using images_iterator = images_type::iterator;
+    using guests_filter_type = slot_vector<bloom_filter::word_t>;
     using duration_t = time_t;
     static constexpr duration_t unspecified_duration = 0;
     static constexpr time_t unspecified_end = 0;
@@ -291,7 +346,7 @@ namespace events {
 		  canceled = 4
     };
 
-    // No overbooking allowed yet.
+    // No overbooking allowed yet. See the seat document for a strict enforcement under concurrency.
     // Capacity is an int so that negative values mean to inherit from the venue's capacity.
     event(
 	  const db::connector& c,
@@ -326,8 +381,12 @@ namespace events {
       _bookings_notice_time(*this, bookings_notice_time),
       _bookings_count(*this, infinite_capacity),
       _images(*this),
-      _report_count(*this)
+      _report_count(*this),
+      _guests_filter(*this),
+      _booking_shards(*this, 0),
+      _seat_documents(*this, false)
     {
+      set_guests_filter(bloom_filter());
       capacity_t vc = ven->get_capacity();
       
       if (is_uninitialized(capacity)){
@@ -340,8 +399,19 @@ namespace events {
       else{
 	_capacity = capacity;
       }
+
+      _seat_documents = get_seat_documents() && has_finite_capacity();
     }
 
+    // A seat counted as booked, by a booking or a hold, see take_seat.
+    struct taken_seat
+    {
+      // Null if the booking count is not sharded.
+      booking_counter_p counter;
+      // Null if the event has no seat documents.
+      seat_p seat;
+    };
+
     user_r get_organizer() const { return *_organizer; }
 
     const string& get_name() const { return _name; }
@@ -364,11 +434,11 @@ namespace events {
 
     venue_r get_venue() const { return *_venue; }
 
-    void set_venue(const venue_r& v){
+    void set_venue(const db::connector& cn, const venue_r& v){
       // Capacity check.
       capacity_t vc = _venue->get_capacity();
 
-      if (is_finite(vc) && (capacity_t)_bookings_count > vc){
+      if (is_finite(vc) && count_bookings(cn) > vc){
 	throw insufficient_capacity();
       }
 
@@ -479,16 +549,17 @@ namespace events {
     capacity_t get_capacity() const { return _capacity; }
 
     // Capacity is an int and not a capacity_t so that -1 can be supplied to indicate inheritance from venue's capacity.
-    void set_capacity(capacity_t capacity){
+    void set_capacity(const db::connector& cn, capacity_t capacity){
       capacity_t vc = _venue->get_capacity();
       
       if (is_uninitialized(capacity)){
 	// Inheriting from the venue's capacity has been requested.
-	if (is_finite(vc) && _bookings_count > vc){
+	if (is_finite(vc) && count_bookings(cn) > vc){
 	  // There are already too many bookings for the venue's capacity.
 	  throw invalid_capacity();
 	}
 	
+	resize_seats(cn, vc);
 	_capacity = vc;
       }
       else{
@@ -497,18 +568,28 @@ namespace events {
 	    // Can't have more capacity than the venue.
 	    (is_finite(vc) && (is_infinite(capacity) || capacity > vc)) ||
 	    // Can't have less capacity than the number of bookings.
-	    (is_finite(capacity) && (capacity_t)_bookings_count > capacity)
+	    (is_finite(capacity) && count_bookings(cn) > capacity)
 	    ){
 	  throw invalid_capacity();
 	}
 
+	resize_seats(cn, capacity);
 	_capacity = capacity;
       }
+
+      if (_booking_shards){
+	allot_booking_counters(cn);
+      }
     }
 
     // A null max capacity means unlimited capacity.
     bool has_unlimited_capacity() const { return is_infinite(_capacity); }
 
+    bool has_finite_capacity() const { return is_finite(_capacity); }
+
+    // Bookings and holds take seat documents, see the seat document.
+    bool has_seat_documents() const { return _seat_documents; }
+
     // Once an event enters its "window" it stays within it, even when the current time
     // has exceeded its end. We should consider renaming.
     bool is_in_window() const {
@@ -528,11 +609,22 @@ namespace events {
     // very specific exceptions to clarify why the caller is not authorized. This being
     // said all these specific exceptions might have to be processed, putting some
     // weight on the client side code.
+    // Seats held count as booked, see seat_hold.
     bool is_bookable() const {
       return (
 	      has_unlimited_capacity() ||
 	      get_bookings_count() < get_capacity()
 	      ) &&
+	is_open_for_bookings();
+    }
+
+    // Same as above, a user holding a seat can book as long as the event is open for bookings. A full event gets back
+    // the seats of its expired holds the sweep has not given back yet.
+    bool is_bookable_by(const db::connector&, const user_r&);
+
+    // Regardless of the capacity.
+    bool is_open_for_bookings() const {
+      return
 	_state <= confirmed && // Trick using states number to make only one test.
 	!is_in_window()
 	;
@@ -549,25 +641,30 @@ namespace events {
 
     time_t get_bookings_notice_time() const { return _bookings_notice_time; }
 
-    capacity_t get_bookings_count() const { return _bookings_count; }
+    // For events with sharded booking counters, the sum is cached for a few seconds and can lag.
+    capacity_t get_bookings_count() const;
 
-    // Checks the notice time.
-    void book(){
-      if (!is_bookable()){
-	throw event_is_not_bookable();
-      }
-      
-      _bookings_count = capacity_t(_bookings_count + 1);
-    }
+    // Always exact. For events with sharded booking counters, gets all the counters.
+    capacity_t count_bookings(const db::connector&) const;
 
-    void unbook(){
-      if (is_in_window()){
-	throw too_late();
-      }
+    // Spreads the booking count of the event over the supplied number of counter documents, so that concurrent
+    // bookings for a large event do not all update the event document. To be called at creation.
+    // The events with sharded counters do not have guests filters, as maintaining them would update the event
+    // document for each booking.
+    void shard_bookings(const db::connector&, size_t shards);
 
-      HX2A_ASSERT(_bookings_count);
-      _bookings_count = capacity_t(_bookings_count - 1);
-    }
+    // Checks the notice time. Takes the seat from the guest's hold, if any, it is already counted.
+    taken_seat book(const db::connector&, const user_r& guest);
+
+    // The seat is the one returned by book.
+    void unbook(const taken_seat&);
+
+    // Counts a seat as booked, for a booking or a hold. When the event is full, gets back the seats of its expired holds
+    // first.
+    taken_seat take_seat(const db::connector&, const user_r&);
+
+    // The seat is the one returned by take_seat. Regardless of the notice time.
+    void give_back_seat(const taken_seat&);
 
     // Returns the invite for the specified user for the event. Returns null if not found.
     invite_p get_invite(const db::connector&, const user_r&) const;
@@ -575,6 +672,40 @@ namespace events {
     // Returns the booking for the specified user for the event. Returns null if not found.
     booking_p get_booking(const db::connector&, const user_r&) const;
 
+    // Same as above, without the guests filter. For the uniqueness checks of creations, a guest missing from the filter
+    // would let a duplicate be created.
+    invite_p lookup_invite(const db::connector&, const user_r&) const;
+    
+    booking_p lookup_booking(const db::connector&, const user_r&) const;
+
+    // Returns false if the user has certainly neither an invite nor a booking for the event, without touching the
+    // database. Events created before guests filters existed answer true until their filter is rebuilt.
+    // The filter is read, modified and written with the event document, which is not saved conditionally. Two
+    // concurrent creations of invites or bookings for the event can lose one of the guests, who is then refused access
+    // until the filter is rebuilt. Creations do not rely on the filter, see above.
+    bool may_have_guest(const user_r& u) const {
+      return get_guests_filter().may_contain(u->get_id());
+    }
+
+    // To call when creating an invite or a booking.
+    void add_guest(const user_r& u){
+      bloom_filter f = get_guests_filter();
+
+      if (!f.is_unknown()){
+	f.add(u->get_id());
+	set_guests_filter(f);
+      }
+    }
+
+    // Recalculates the guests filter from the invites and bookings indexes. Also repairs the guests lost by concurrent
+    // creations, see may_have_guest.
+    // Refused for events with sharded booking counters, they have no filter so that bookings do not write the event.
+    void rebuild_guests_filter(const db::connector&);
+
+    // Returns true if the user is the organizer or has an invite or a booking for the event.
+    // Served from the access cache when possible.
+    bool has_access(const db::connector&, const user_r&) const;
+
     const images_type& get_images() const { return _images; }
 
     void push_image_back(string image){
@@ -613,11 +744,11 @@ namespace events {
 
     // Privacy cannot be updated, as it is a search criteria in the in-memory index.
     // Capacity is an int and not a capacity_t so that -1 can be supplied to indicate inheritance from venue's capacity.
-    void update(string name, category_t cat, string category_description, capacity_t capacity, time_t start, duration_t duration, time_t bookings_notice_time){
+    void update(const db::connector& cn, string name, category_t cat, string category_description, capacity_t capacity, time_t start, duration_t duration, time_t bookings_notice_time){
       _name = name;
       _category = cat;
       _category_description = category_description;
-      set_capacity(capacity); // Does the extra work related to inheriting the venue's capacity, if needed, plus checks.
+      set_capacity(cn, capacity); // Does the extra work related to inheriting the venue's capacity, if needed, plus checks.
       _start = start;
       _duration = duration;
       _end = calculate_end(start, duration);
@@ -660,6 +791,34 @@ namespace events {
   private:
 
     static time_t calculate_end(time_t start, time_t duration){ return duration == unspecified_duration ? unspecified_end : start + duration; }
+
+    // Spreads the remaining capacity over the counters.
+    void allot_booking_counters(const db::connector&);
+
+    // Counts a seat on the event, or on a counter with room, preferably the user's. Takes a seat document as well, if
+    // the event has them. Returns false if full.
+    bool count_seat(const db::connector&, const user_r&, taken_seat&);
+
+    // Takes the first free seat document from the supplied seat number on. Returns null if none is found within the
+    // probes limit.
+    seat_p claim_seat(const db::connector&, size_t start);
+
+    // Seats numbered beyond a lower capacity would be taken on top of it, the capacity is refused. An event going
+    // unlimited stops using seat documents for good, the bookings made meanwhile would have none.
+    void resize_seats(const db::connector&, capacity_t);
+
+    // The holds the sweep has missed or not reached yet. Returns the number of holds removed.
+    size_t give_back_expired_holds(const db::connector&);
+
+    bloom_filter get_guests_filter() const { return {_guests_filter.cbegin(), _guests_filter.cend()}; }
+
+    void set_guests_filter(const bloom_filter& f){
+      _guests_filter.clear();
+
+      for (bloom_filter::word_t w: f.get_words()){
+	_guests_filter.push_back(w);
+      }
+    }
     
     link<user> _organizer;
     slot<string> _name;
@@ -681,10 +840,185 @@ namespace events {
     slot<time_t> _end;
     slot<time_t> _bookings_notice_time;
     // The number of bookings could be calculated using the index on all bookings. It would be costly. We denormalize.
+    // Unused if the booking count is sharded.
     slot<capacity_t> _bookings_count;
     // Storing only the URLs.
     images_type _images;
     slot<uint64_t> _report_count;
+    // Guests with an invite or a booking, see bloom.hpp. Avoids the lookups for users who have none, the most frequent
+    // case for private events. Empty for events created before filters existed.
+    guests_filter_type _guests_filter;
+    // Number of booking counter documents. Null if the booking count is on the event document.
+    slot<size_t> _booking_shards;
+    // False for events created before seat documents, or which have had an unlimited capacity.
+    slot<bool> _seat_documents;
+  };
+
+  // A shard of the booking count of an event. Each counter has an allotment of the capacity, so that counters are
+  // updated independently without exceeding the capacity in total. Concurrent updates of the same counter can still be
+  // lost, only seat documents enforce the capacity strictly, see the seat document.
+  class booking_counter: public root<>
+  {
+    HX2A_ROOT(booking_counter, type_tag<"booking_counter">, 1, root,
+	      ((_event, "e"),
+	       (_count, "c"),
+	       (_allotment, "a")));
+  public:
+
+    using count_t = unsigned int;
+
+    booking_counter(const event_r& e, count_t allotment):
+      _event(*this, e),
+      _count(*this, 0),
+      _allotment(*this, allotment)
+    {
+    }
+
+    // The derived identifier of a counter of an event, see doc_ids.hpp.
+    static doc_id make_id(const doc_id& event_id, size_t shard){
+      return derived_doc_id("bcn", event_id, shard);
+    }
+
+    count_t get_count() const { return _count; }
+
+    count_t get_allotment() const { return _allotment; }
+
+    void set_allotment(count_t a){ _allotment = a; }
+
+    // The allotment is meaningless for events with unlimited capacity.
+    bool is_full() const { return !_event->has_unlimited_capacity() && _count >= _allotment; }
+
+    void book(){
+      HX2A_ASSERT(!is_full());
+      _count = _count + 1;
+    }
+
+    void unbook(){
+      HX2A_ASSERT(_count);
+      _count = _count - 1;
+    }
+
+  private:
+
+    // The counters disappear with the event.
+    link<event> _event;
+    slot<count_t> _count;
+    slot<count_t> _allotment;
+  };
+
+  // A seat of an event with seat documents, taken by a booking or a hold. Documents are not saved conditionally, so two
+  // concurrent bookings can both read a count with room left and both write it. Seats make that harmless: seat numbers
+  // are below the capacity and seat identifiers are derived from them, two concurrent takers of the same seat cannot
+  // both insert it, see doc_ids.hpp. The bookings and holds of the event never exceed its capacity, the booking count
+  // is only the fast way to tell whether there is room.
+  class seat: public root<>
+  {
+    HX2A_ROOT(seat, type_tag<"seat">, 1, root,
+	      ((_event, "e"),
+	       (_number, "n")));
+  public:
+
+    seat(const event_r& e, capacity_t number):
+      _event(*this, e),
+      _number(*this, number)
+    {
+    }
+
+    // The derived identifier of a seat of an event, see doc_ids.hpp.
+    static doc_id make_id(const doc_id& event_id, capacity_t number){
+      return derived_doc_id("st", event_id, number);
+    }
+
+    capacity_t get_number() const { return _number; }
+
+  private:
+
+    // The seats disappear with the event.
+    link<event> _event;
+    slot<capacity_t> _number;
+  };
+
+  // A seat of an event reserved for a while by a user, e.g., during a checkout. The booking the user makes as guest,
+  // calling book or accepting an invite, takes its seat.
+  // The seat is counted as booked as soon as it is held, on the event or on one of its booking counters, so that
+  // capacity is checked the same way with or without holds. The seat of an expired hold is given back by the sweep
+  // service, when the holder books or holds again, or when the event is found full.
+  // At most one per event and holder, see the derived identifier.
+  class seat_hold: public root<>
+  {
+    HX2A_ROOT(seat_hold, type_tag<"seat_hold">, 1, root,
+	      ((_event, "e"),
+	       (_holder_id, "h"),
+	       (_expiry_timestamp, "x"),
+	       (_expiry_minute, "xm"),
+	       (_counter, "bcn"),
+	       (_seat, "st")));
+  public:
+
+    static constexpr time_t seconds_per_minute = 60;
+
+    seat_hold(const event_r& e, const doc_id& holder_id):
+      _event(*this, e),
+      _holder_id(*this, holder_id),
+      _expiry_timestamp(*this, 0),
+      _expiry_minute(*this, 0),
+      _counter(*this),
+      _seat(*this)
+    {
+    }
+
+    // The derived identifier of the hold of a user for an event, see doc_ids.hpp.
+    static doc_id make_id(const doc_id& event_id, const doc_id& holder_id){
+      return derived_doc_id("sh", event_id, holder_id);
+    }
+
+    static seat_hold_p get(const db::connector& cn, const doc_id& event_id, const user_r& holder){
+      return root_get<seat_hold>(cn, make_id(event_id, holder->get_id()));
+    }
+
+    // Takes a seat, or extends the holder's hold. Returns the expiry timestamp.
+    static time_t hold(const db::connector&, const event_r&, const user_r& holder);
+
+    // Does nothing if the holder has no hold.
+    static void release(const db::connector&, const event_r&, const user_r& holder);
+
+    // Gives back the seats of the holds expired for a while. Goes back the configured number of minutes. Returns the
+    // number of holds removed.
+    static size_t sweep(const db::connector&);
+
+    // Does not load the user.
+    const doc_id& get_holder_id() const { return _holder_id; }
+
+    time_t get_expiry_timestamp() const { return _expiry_timestamp; }
+
+    bool is_expired(time_t now) const { return now >= _expiry_timestamp; }
+
+    // For a booking. The seat is already counted. The hold disappears.
+    event::taken_seat use_seat();
+
+    // The hold disappears as well.
+    void give_back();
+
+    // Indexes.
+
+    static constexpr tag_t index_by_event = config_name<"sh_e">;
+
+    static constexpr tag_t index_by_expiry_minute = config_name<"sh_xm">;
+
+  private:
+
+    void extend();
+
+    // The holds disappear with the event.
+    link<event> _event;
+    slot<doc_id> _holder_id;
+    slot<time_t> _expiry_timestamp;
+    // So that the sweep finds the expired holds with exact keys.
+    slot<time_t> _expiry_minute;
+    // Null if the booking count of the event is not sharded.
+    weak_link<booking_counter> _counter;
+    // Null if the event has no seat documents.
+    weak_link<seat> _seat;
   };
 
   // Used as well as a payload.
@@ -720,13 +1054,164 @@ namespace events {
     slot<string> _email;
   };
   
+  // Removals log, for the Apps to synchronize their lists of bookings, invites and open invites incrementally.
+  // Documents created or updated are found with the indexes by save timestamp. Removed ones are not there any longer, so
+  // their removal is logged for the user whose list they were in.
+  // Removals cascading from the removal of a linked document (e.g., an event and its bookings) are not logged. The
+  // corresponding event is then not found by the App when it refreshes it.
+  // Removals are kept for a configured period, after which they are removed by the sweep service. An App which last
+  // synchronized before that must synchronize fully.
+  class removal: public root<>
+  {
+    HX2A_ROOT(removal, type_tag<"removal">, 1, root,
+	      ((_user, "u"),
+	       (_removed_id, "r"),
+	       (_kind, "k"),
+	       (_day, "d")));
+  public:
+
+    static constexpr time_t seconds_per_day = 24 * 60 * 60;
+
+    // Values assigned so that saved documents are consistent across evolutions of the backend.
+    enum kind_t {
+		 booking_removal = 0,
+		 invite_removal = 1,
+		 open_invite_removal = 2
+    };
+
+    removal(const user_r& u, const doc_id& removed_id, kind_t k):
+      _user(*this, u),
+      _removed_id(*this, removed_id),
+      _kind(*this, k),
+      _day(*this, time() / seconds_per_day)
+    {
+    }
+
+    user_r get_user() const { return *_user; }
+
+    const doc_id& get_removed_id() const { return _removed_id; }
+
+    kind_t get_kind() const { return _kind; }
+
+    static void log(const db::connector& cn, const user_r& u, const doc_id& removed_id, kind_t k){
+      make<removal>(cn, u, removed_id, k);
+    }
+
+    // Returns true if all the removals since the timestamp are still there.
+    static bool are_kept_since(time_t);
+
+    // Removes the removals older than the retention period, going back the configured number of days before that.
+    // Returns the number of removals removed.
+    static size_t sweep(const db::connector&);
+
+    // Indexes.
+
+    static constexpr tag_t index_by_user_and_creation_timestamp = config_name<"r_u_c">;
+
+    static constexpr tag_t index_by_day = config_name<"r_d">;
+
+  private:
+
+    // Removals are removed with the user.
+    link<user> _user;
+    slot<doc_id> _removed_id;
+    slot<kind_t> _kind;
+    // In days since the epoch. Removals logged before it was recorded have a null day and are not swept.
+    slot<time_t> _day;
+  };
+
+  // A user's agenda. One item per booking and per invite of the user, sorted by event start through an index, so that
+  // the home screen of the App is served by a single paginated service without loading the events.
+  // Items are created with their booking or invite, and removed with them. They are updated when the event is.
+  // Open invites are keyed by email and are not in the agenda.
+  class agenda_item: public root<>
+  {
+    HX2A_ROOT(agenda_item, type_tag<"agenda_item">, 1, root,
+	      ((_user, "u"),
+	       (_event, "e"),
+	       (_kind, "k"),
+	       (_item_id, "i"),
+	       (_event_id, "ei"),
+	       (_event_name, "n"),
+	       (_event_start, "s")));
+  public:
+
+    // Values assigned so that saved documents are consistent across evolutions of the backend.
+    enum kind_t {
+		 booking_item = 0,
+		 invite_item = 1
+    };
+
+    agenda_item(const user_r& u, const event_r& e, kind_t k, const doc_id& item_id):
+      _user(*this, u),
+      _event(*this, e),
+      _kind(*this, k),
+      _item_id(*this, item_id),
+      _event_id(*this, e->get_id()),
+      _event_name(*this, e->get_name()),
+      _event_start(*this, e->get_start())
+    {
+    }
+
+    user_r get_user() const { return *_user; }
+
+    event_r get_event() const { return *_event; }
+
+    kind_t get_kind() const { return _kind; }
+
+    // The booking or invite document identifier.
+    const doc_id& get_item_id() const { return _item_id; }
+
+    // Does not load the event.
+    const doc_id& get_event_id() const { return _event_id; }
+
+    const string& get_event_name() const { return _event_name; }
+
+    time_t get_event_start() const { return _event_start; }
+
+    // Copies the event data again. Items already up to date are not modified, so that they are not saved.
+    void update(){
+      event_r e = *_event;
+
+      if (_event_name.get() != e->get_name()){
+	_event_name = e->get_name();
+      }
+
+      if (_event_start != e->get_start()){
+	_event_start = e->get_start();
+      }
+    }
+
+    // To be called when the event name or start change.
+    static void update(const db::connector&, const event_r&);
+
+    // Indexes.
+
+    static constexpr tag_t index_by_event = config_name<"a_e">;
+
+    static constexpr tag_t index_by_user_and_event_start = config_name<"a_u_s">;
+
+  private:
+
+    // The items disappear with the user or the event.
+    link<user> _user;
+    link<event> _event;
+    slot<kind_t> _kind;
+    slot<doc_id> _item_id;
+    // Copies of the event data, so that listing the agenda does not load the events.
+    slot<doc_id> _event_id;
+    slot<string> _event_name;
+    slot<time_t> _event_start;
+  };
+
   // Invite without an identified guest. The invite can be shared with multiple guests.
   class open_invite: public root<>
   {
     HX2A_ROOT(open_invite, type_tag<"open_invite">, 1, root,
 	      ((_event, "e"),
 	       (_host, "h"),
-	       (_contacts, "c")));
+	       (_contacts, "c"),
+	       (_stored_contacts_count, "scc")));
   public:
 
     using contacts_type = own_vector<contact>;
@@ -737,7 +1222,8 @@ namespace events {
 		):
       _event(*this, e),
       _host(*this, host),
-      _contacts(*this)
+      _contacts(*this),
+      _stored_contacts_count(*this, 0)
     {
     }
 
@@ -748,23 +1234,10 @@ namespace events {
     // Adds only if the email address is not yet present.
     // The first and last names can be empty.
     // Validates if the email looks like an email address.
-    void add_contact(const contact_r& cont){
-      if (_contacts.size() == get_contacts_in_open_invite_limit()){
-	throw contacts_in_open_invite_limit_reached();
-      }
+    // Beyond the inline limit, contacts are stored in their own documents, see open_invite_contact.
+    void add_contact(const db::connector&, const contact_r&);
 
-      const string& email = cont->get_email();
-      auto e = _contacts.cend();
-      auto i = ::std::find_if(_contacts.cbegin(), e, [email](const auto& c){
-						       HX2A_ASSERT(c);
-						       return c->get_email() == email;
-						   });
-
-      if (i == e){
-	_contacts.push_back(cont);
-      }
-      // Otherwise we silently return without any fuss.
-    }
+    // Only the contacts held inline.
 
     contacts_type::const_iterator find_contact(const string& email) const {
       return ::std::find_if(_contacts.cbegin(), _contacts.cend(), [email](const auto& c){
@@ -776,17 +1249,23 @@ namespace events {
     contacts_type::const_iterator contacts_cbegin() const { return _contacts.cbegin(); }
 
     contacts_type::const_iterator contacts_cend() const { return _contacts.cend(); }
+
+    // Inline and stored.
+    size_t get_contacts_count() const { return _contacts.size() + _stored_contacts_count; }
     
     // Returns the newly created booking. The email disappears.
     // Creating the booking will increment the booking count of the event.
     booking_r accept(const db::connector&, const user_r& guest, string display_name, string note);
 
-    void decline(const user_r& guest);
+    void decline(const db::connector&, const user_r& guest);
 
     // Indexes.
 
+    // Only the contacts held inline. See open_invite_contact for the others.
     static constexpr tag_t index_by_email = config_name<"oi_ce">;
 
+    static constexpr tag_t index_by_email_and_save_timestamp = config_name<"oi_ce_s">;
+
     static constexpr tag_t index_by_event = config_name<"oi_e">;
 
   private:
@@ -797,6 +1276,51 @@ namespace events {
     // It's a strong link because we retract the open invite if the host is removed.
     link<user> _host;
     contacts_type _contacts;
+    slot<size_t> _stored_contacts_count;
+
+    // Returns null if the email address is not among the stored contacts.
+    open_invite_contact_p get_stored_contact(const db::connector&, const string& email) const;
+
+    // Erases the inline contact, or the stored one if supplied.
+    void erase_contact(contacts_type::const_iterator, const open_invite_contact_p&);
+  };
+
+  // Contact of an open invite beyond the ones held inline by the open invite. Open invites can be sent to thousands
+  // of addresses this way.
+  // The identifier is derived from the open invite and the email address, so finding a contact is a single document get.
+  class open_invite_contact: public root<>
+  {
+    HX2A_ROOT(open_invite_contact, type_tag<"open_invite_contact">, 1, root,
+	      ((_open_invite, "oi"),
+	       (_contact, "c")));
+  public:
+
+    open_invite_contact(const open_invite_r& oi, const contact_r& c):
+      _open_invite(*this, oi),
+      _contact(*this, c)
+    {
+    }
+
+    // The derived identifier of the contact of an open invite, see doc_ids.hpp.
+    static doc_id make_id(const doc_id& open_invite_id, const string& email){
+      return derived_doc_id("oic", open_invite_id, email);
+    }
+
+    open_invite_r get_open_invite() const { return *_open_invite; }
+
+    contact_r get_contact() const { return *_contact; }
+
+    // Indexes.
+
+    static constexpr tag_t index_by_email = config_name<"oic_ce">;
+
+    static constexpr tag_t index_by_email_and_save_timestamp = config_name<"oic_ce_s">;
+
+  private:
+
+    // The contact disappears with the open invite.
+    link<open_invite> _open_invite;
+    own<contact> _contact;
   };
 
   // Especially useful for private events.
@@ -805,7 +1329,8 @@ namespace events {
     HX2A_ROOT(invite, type_tag<"invite">, 1, root,
 	      ((_event, "e"),
 	       (_host, "h"),
-	       (_guest, "g")));
+	       (_guest, "g"),
+	       (_agenda_item, "ai")));
   public:
 
     invite(
@@ -815,10 +1340,23 @@ namespace events {
 	   ):
       _event(*this, e),
       _host(*this, host),
-      _guest(*this, guest)
+      _guest(*this, guest),
+      _agenda_item(*this)
     {
     }
 
+    // Creates the invite and the guest's agenda item.
+    // Throws if an invite or a booking already exists for the event and the guest.
+    static invite_r create(const db::connector&, const event_r&, const user_r& host, const user_r& guest);
+
+    // Same as above, but returns null instead of throwing, for bulk creations.
+    static invite_p create_if_new(const db::connector&, const event_r&, const user_r& host, const user_r& guest);
+
+    // The derived identifier of the invite of a guest for an event, see doc_ids.hpp.
+    static doc_id make_id(const doc_id& event_id, const doc_id& guest_id){
+      return derived_doc_id("i", event_id, guest_id);
+    }
+
     event_r get_event() const { return *_event; }
 
     user_r get_host() const { return *_host; }
@@ -832,19 +1370,46 @@ namespace events {
     
     void send_email() const;
 
-    void notify_devices() const;
+    void notify_devices() const {
+      push_batcher b;
+      notify_devices(b, doc_id{});
+    }
+
+    // The messages are sent when the batcher flushes. The source is recorded with them, see push_batcher::add.
+    void notify_devices(push_batcher&, const doc_id& source) const;
 
     // Returns the newly created booking. The invite disappears.
     // Creating the booking will increment the booking count of the event.
     booking_r accept(const db::connector&, string display_name, string note);
 
+    // The invite disappears.
+    void decline(const db::connector& cn){
+      get_access_cache().erase(_event->get_id(), _guest->get_id());
+      removal::log(cn, *_guest, get_id(), removal::invite_removal);
+      remove_agenda_item();
+      unpublish();
+    }
+
     // Indexes.
 
+    static constexpr tag_t index_by_event = config_name<"i_e">;
+
     static constexpr tag_t index_by_event_and_guest = config_name<"i_e_g">;
 
     static constexpr tag_t index_by_guest = config_name<"i_g">;
 
+    static constexpr tag_t index_by_guest_and_save_timestamp = config_name<"i_g_s">;
+
   private:
+
+    // Without existence checks.
+    static invite_r make_new(const db::connector&, const event_r&, const user_r& host, const user_r& guest);
+
+    void remove_agenda_item(){
+      if (agenda_item_p ai = _agenda_item){
+	(*ai)->unpublish();
+      }
+    }
     
     // An invite disappears if the event is removed.
     link<event> _event;
@@ -853,6 +1418,8 @@ namespace events {
     link<user> _host;
     // An invite disappears when the guest user is removed.
     link<user> _guest;
+    // Null for invites created before agendas.
+    weak_link<agenda_item> _agenda_item;
   };
 
   // The document identifier of the booking can be used to generate a 2D barcode that can be scanned at event
@@ -867,7 +1434,10 @@ namespace events {
 	       (_guest, "g"),
 	       (_messenger_participation, "mp"),
 	       (_note, "n"),
-	       (_check_in_timestamp, "cit")));
+	       (_check_in_timestamp, "cit"),
+	       (_agenda_item, "ai"),
+	       (_counter, "bcn"),
+	       (_seat, "st")));
   public:
 
     // Increments the booking count of the event.
@@ -884,7 +1454,10 @@ namespace events {
       _guest(*this, guest),
       _messenger_participation(*this),
       _note(*this, std::move(note)),
-      _check_in_timestamp(*this, 0)
+      _check_in_timestamp(*this, 0),
+      _agenda_item(*this),
+      _counter(*this),
+      _seat(*this)
     {
       messenger::conversation_p conv = e->get_conversation();
 	
@@ -896,7 +1469,24 @@ namespace events {
       }
 
       // Incrementing the booking count.
-      e->book();
+      event::taken_seat ts = e->book(c, guest);
+
+      if (ts.counter){
+	_counter = *ts.counter;
+      }
+
+      if (ts.seat){
+	_seat = *ts.seat;
+      }
+    }
+
+    // Creates the booking and the guest's agenda item.
+    // Throws if a booking already exists for the event and the guest.
+    static booking_r create(const db::connector&, const event_r&, const user_r& host, const user_r& guest, string display_name, string note);
+
+    // The derived identifier of the booking of a guest for an event, see doc_ids.hpp.
+    static doc_id make_id(const doc_id& event_id, const doc_id& guest_id){
+      return derived_doc_id("b", event_id, guest_id);
     }
 
     event_r get_event() const { return *_event; }
@@ -930,9 +1520,9 @@ namespace events {
       _check_in_timestamp = time();
     }
 
-    void cancel(){
+    void cancel(const db::connector& cn){
       // Giving back to the inventory.
-      _event->unbook();
+      _event->unbook({_counter, _seat});
       
       // Removing the participation if the user is not the organizer of the event.
       // If he is, his participation stays.
@@ -940,16 +1530,27 @@ namespace events {
 	_messenger_participation->unpublish();
       }
 
+      get_access_cache().erase(_event->get_id(), _guest->get_id());
+      removal::log(cn, *_guest, get_id(), removal::booking_removal);
+
+      if (agenda_item_p ai = _agenda_item){
+	(*ai)->unpublish();
+      }
+      
       // Seppuku.
       unpublish();
     }
 
     // Indexes.
 
+    static constexpr tag_t index_by_event = config_name<"b_e">;
+
     static constexpr tag_t index_by_event_and_guest = config_name<"b_e_g">;
 
     static constexpr tag_t index_by_guest = config_name<"b_g">;
 
+    static constexpr tag_t index_by_guest_and_save_timestamp = config_name<"b_g_s">;
+
     static constexpr tag_t index_by_event_and_checkin_timestamp = config_name<"b_e_cit">;
 
   private:
@@ -964,6 +1565,12 @@ namespace events {
     slot<string> _note;
     // If used, 0 means not checked in.
     slot<time_t> _check_in_timestamp;
+    // Null for bookings created before agendas.
+    weak_link<agenda_item> _agenda_item;
+    // Null if the booking count of the event is not sharded.
+    weak_link<booking_counter> _counter;
+    // Null if the event has no seat documents.
+    weak_link<seat> _seat;
   };
 
   class news: public root<>
@@ -1016,6 +1623,146 @@ namespace events {
     slot<time_t> _expiry_timestamp;
   };
   
+  // Outbox of notifications. When enabled, services record the notifications to send and return without waiting for
+  // the mail server or Expo. The drain service, called periodically, sends them and retries the failures with an
+  // exponential backoff.
+  // Delivery is at least once: a notification sent by a drain that then fails to save is sent again.
+  class notification: public root<>
+  {
+    HX2A_ROOT(notification, type_tag<"notification">, 1, root,
+	      ((_kind, "k"),
+	       (_invite, "i"),
+	       (_state, "st"),
+	       (_attempts, "a"),
+	       (_next_attempt_timestamp, "na"),
+	       (_bucket, "b"),
+	       (_lease_owner, "lo")));
+  public:
+
+    // The minutes of the next attempts, so that the due notifications are found with exact keys.
+    static constexpr time_t seconds_per_bucket = 60;
+
+    // Values assigned so that saved documents are consistent across evolutions of the backend.
+    // The email and the devices notifications are retried independently.
+    enum kind_t {
+		 invite_email = 0,
+		 invite_devices = 1
+    };
+
+    // A claimed notification is sent by the next drain of the worker which claimed it, until its lease expires. Then
+    // by the first drain finding it, on any worker.
+    enum state_t {
+		  pending = 0,
+		  failed = 1,
+		  claimed = 2
+    };
+    
+    notification(kind_t k, const invite_r& i):
+      _kind(*this, k),
+      _invite(*this, i),
+      _state(*this, pending),
+      _attempts(*this, 0),
+      _next_attempt_timestamp(*this),
+      _bucket(*this),
+      _lease_owner(*this)
+    {
+      schedule(time());
+    }
+
+    kind_t get_kind() const { return _kind; }
+
+    state_t get_state() const { return _state; }
+
+    time_t get_next_attempt_timestamp() const { return _next_attempt_timestamp; }
+
+    // Notifies the invite's guest, through the outbox if enabled, immediately otherwise.
+    static void post(const db::connector&, const invite_r&);
+
+    // Sends the notification. Returns true and removes the notification if successful. Otherwise schedules the next
+    // attempt, or marks the notification as failed after too many attempts.
+    // Devices notifications are only handed to the batcher, they are kept until completed once it is flushed.
+    bool send(push_batcher&);
+
+    // For devices notifications, once the batcher is flushed. Returns true and removes the notification if none of its
+    // messages failed. Otherwise the notification is retried as above.
+    bool complete(const push_batcher&);
+
+    // Sends the notifications claimed by the previous drains of the worker, and the ones claimed by any worker with an
+    // expired lease. Then claims the due ones, at most the drain limit, for the next drain of the worker. The claims are
+    // saved when the service completes, before anything is sent, so that concurrent drains do not send the same
+    // notifications, except the ones with expired leases found by two drains at once.
+    // The buckets are read from the drain mark on, see notifications_drain_mark. Returns the number sent.
+    static size_t drain(const db::connector&);
+
+    // Indexes.
+
+    static constexpr tag_t index_by_state_and_bucket = config_name<"nt_st_b">;
+
+    static constexpr tag_t index_by_state_and_lease_owner = config_name<"nt_st_lo">;
+
+  private:
+
+    // Returns false if not pending or not due.
+    bool claim(const doc_id& owner, time_t now);
+
+    bool is_claimed_by(const doc_id& owner, time_t now) const {
+      return _state == claimed && doc_id(_lease_owner) == owner && now < _next_attempt_timestamp;
+    }
+
+    // The worker which claimed it has not sent it in time.
+    bool is_lease_expired(time_t now) const { return _state == claimed && now >= _next_attempt_timestamp; }
+
+    void retry(const char* reason);
+
+    void schedule(time_t t){
+      _next_attempt_timestamp = t;
+      _bucket = t / seconds_per_bucket;
+    }
+
+    slot<kind_t> _kind;
+    // Nothing to send if the invite disappears.
+    link<invite> _invite;
+    slot<state_t> _state;
+    slot<unsigned int> _attempts;
+    // The lease expiry when claimed.
+    slot<time_t> _next_attempt_timestamp;
+    slot<time_t> _bucket;
+    // The worker which claimed the notification, null otherwise.
+    slot<doc_id> _lease_owner;
+  };
+
+  // The first bucket of notifications the drains read, shared by the workers so that the buckets before a restart or an
+  // outage are still read. A single document.
+  class notifications_drain_mark: public root<>
+  {
+    HX2A_ROOT(notifications_drain_mark, type_tag<"notifications_drain_mark">, 1, root,
+	      ((_bucket, "b")));
+  public:
+
+    notifications_drain_mark(time_t bucket):
+      _bucket(*this, bucket)
+    {
+    }
+
+    // The derived identifier of the single document, see doc_ids.hpp.
+    static doc_id make_id(){
+      return derived_doc_id("ndm");
+    }
+
+    time_t get_bucket() const { return _bucket; }
+
+    // Never goes back, concurrent drains can have moved it further.
+    void advance(time_t bucket){
+      if (bucket > _bucket){
+	_bucket = bucket;
+      }
+    }
+
+  private:
+
+    slot<time_t> _bucket;
+  };
+  
   inline void venue_claim::accept(){
     _venue->transfer(*_user);
     // Remove oneself.
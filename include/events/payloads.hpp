@@ -6,6 +6,8 @@
 #ifndef EVENTS_PAYLOADS_HPP
 #define EVENTS_PAYLOADS_HPP
 
+#include <limits>
+
 #include "hx2a/element.hpp"
 
 #include "hx2a/components/area.hpp"
@@ -28,6 +30,10 @@ namespace events {
   using min_app_version_payload_p = ptr<min_app_version_payload>;
   using min_app_version_payload_r = rfr<min_app_version_payload>;
 
+  class count_payload;
+  using count_payload_p = ptr<count_payload>;
+  using count_payload_r = rfr<count_payload>;
+
   class venue_claim_data_payload;
   using venue_claim_data_payload_p = ptr<venue_claim_data_payload>;
   using venue_claim_data_payload_r = rfr<venue_claim_data_payload>;
@@ -48,6 +54,14 @@ namespace events {
   using venue_data_with_id_payload_p = ptr<venue_data_with_id_payload>;
   using venue_data_with_id_payload_r = rfr<venue_data_with_id_payload>;
 
+  class venue_get_payload;
+  using venue_get_payload_p = ptr<venue_get_payload>;
+  using venue_get_payload_r = rfr<venue_get_payload>;
+
+  class venue_data_with_etag_payload;
+  using venue_data_with_etag_payload_p = ptr<venue_data_with_etag_payload>;
+  using venue_data_with_etag_payload_r = rfr<venue_data_with_etag_payload>;
+
   class venue_search_data_payload;
   using venue_search_data_payload_p = ptr<venue_search_data_payload>;
   using venue_search_data_payload_r = rfr<venue_search_data_payload>;
@@ -72,6 +86,14 @@ namespace events {
   using event_data_with_id_payload_p = ptr<event_data_with_id_payload>;
   using event_data_with_id_payload_r = rfr<event_data_with_id_payload>;
 
+  class event_get_payload;
+  using event_get_payload_p = ptr<event_get_payload>;
+  using event_get_payload_r = rfr<event_get_payload>;
+
+  class event_data_with_etag_payload;
+  using event_data_with_etag_payload_p = ptr<event_data_with_etag_payload>;
+  using event_data_with_etag_payload_r = rfr<event_data_with_etag_payload>;
+
   class event_details_payload;
   using event_details_payload_p = ptr<event_details_payload>;
   using event_details_payload_r = rfr<event_details_payload>;
@@ -92,6 +114,10 @@ namespace events {
   using event_search_reply_p = ptr<event_search_reply>;
   using event_search_reply_r = rfr<event_search_reply>;
 
+  class event_pin_payload;
+  using event_pin_payload_p = ptr<event_pin_payload>;
+  using event_pin_payload_r = rfr<event_pin_payload>;
+
   class event_data_for_organizer_payload;
   using event_data_for_organizer_payload_p = ptr<event_data_for_organizer_payload>;
   using event_data_for_organizer_payload_r = rfr<event_data_for_organizer_payload>;
@@ -128,10 +154,26 @@ namespace events {
   using open_invite_add_contact_payload_p = ptr<open_invite_add_contact_payload>;
   using open_invite_add_contact_payload_r = rfr<open_invite_add_contact_payload>;
   
+  class open_invite_add_contacts_payload;
+  using open_invite_add_contacts_payload_p = ptr<open_invite_add_contacts_payload>;
+  using open_invite_add_contacts_payload_r = rfr<open_invite_add_contacts_payload>;
+  
+  class guest_ids_payload;
+  using guest_ids_payload_p = ptr<guest_ids_payload>;
+  using guest_ids_payload_r = rfr<guest_ids_payload>;
+  
   class invite_create_payload;
   using invite_create_payload_p = ptr<invite_create_payload>;
   using invite_create_payload_r = rfr<invite_create_payload>;
   
+  class invites_create_payload;
+  using invites_create_payload_p = ptr<invites_create_payload>;
+  using invites_create_payload_r = rfr<invites_create_payload>;
+  
+  class invite_ids_payload;
+  using invite_ids_payload_p = ptr<invite_ids_payload>;
+  using invite_ids_payload_r = rfr<invite_ids_payload>;
+  
   class invite_data_payload;
   using invite_data_payload_p = ptr<invite_data_payload>;
   using invite_data_payload_r = rfr<invite_data_payload>;
@@ -144,10 +186,18 @@ namespace events {
   using booking_data_with_id_payload_p = ptr<booking_data_with_id_payload>;
   using booking_data_with_id_payload_r = rfr<booking_data_with_id_payload>;
 
+  class booking_get_payload;
+  using booking_get_payload_p = ptr<booking_get_payload>;
+  using booking_get_payload_r = rfr<booking_get_payload>;
+
   class booking_and_event_data_payload;
   using booking_and_event_data_payload_p = ptr<booking_and_event_data_payload>;
   using booking_and_event_data_payload_r = rfr<booking_and_event_data_payload>;
 
+  class booking_and_event_data_with_etag_payload;
+  using booking_and_event_data_with_etag_payload_p = ptr<booking_and_event_data_with_etag_payload>;
+  using booking_and_event_data_with_etag_payload_r = rfr<booking_and_event_data_with_etag_payload>;
+
   class venue_claim_id_payload;
   using venue_claim_id_payload_p = ptr<venue_claim_id_payload>;
   using venue_claim_id_payload_r = rfr<venue_claim_id_payload>;
@@ -180,6 +230,18 @@ namespace events {
   using booking_id_payload_p = ptr<booking_id_payload>;
   using booking_id_payload_r = rfr<booking_id_payload>;
 
+  class book_reply_payload;
+  using book_reply_payload_p = ptr<book_reply_payload>;
+  using book_reply_payload_r = rfr<book_reply_payload>;
+
+  class seat_hold_expiry_payload;
+  using seat_hold_expiry_payload_p = ptr<seat_hold_expiry_payload>;
+  using seat_hold_expiry_payload_r = rfr<seat_hold_expiry_payload>;
+
+  class retry_after_payload;
+  using retry_after_payload_p = ptr<retry_after_payload>;
+  using retry_after_payload_r = rfr<retry_after_payload>;
+
   class news_id_payload;
   using news_id_payload_p = ptr<news_id_payload>;
   using news_id_payload_r = rfr<news_id_payload>;
@@ -192,6 +254,130 @@ namespace events {
   using news_data_payload_p = ptr<news_data_payload>;
   using news_data_payload_r = rfr<news_data_payload>;
 
+  class agenda_item_data_payload;
+  using agenda_item_data_payload_p = ptr<agenda_item_data_payload>;
+  using agenda_item_data_payload_r = rfr<agenda_item_data_payload>;
+
+  class removal_data_payload;
+  using removal_data_payload_p = ptr<removal_data_payload>;
+  using removal_data_payload_r = rfr<removal_data_payload>;
+
+  class timestamp_payload;
+  using timestamp_payload_p = ptr<timestamp_payload>;
+  using timestamp_payload_r = rfr<timestamp_payload>;
+
+  // Sparse fieldsets.
+  // Search queries can carry a mask of the fields the client wants in the reply. The App map pins for instance only
+  // need a handful of them. A null mask means all the fields, which is what older Apps get.
+  // Fields which are not requested are left to their default values and, more importantly, the links they would
+  // require following (owner, organizer, venue, conversation) are not dereferenced.
+  // Each bit is named after the tag of the field. The values are part of the protocol, never renumber them.
+  using field_mask_t = uint64_t;
+
+  enum field_t: field_mask_t {
+			      address_field                     = field_mask_t(1) << 0,
+			      bookable_field                    = field_mask_t(1) << 1,
+			      bookings_notice_time_field        = field_mask_t(1) << 2,
+			      capacity_field                    = field_mask_t(1) << 3,
+			      category_description_field        = field_mask_t(1) << 4,
+			      category_field                    = field_mask_t(1) << 5,
+			      conversation_id_field             = field_mask_t(1) << 6,
+			      description_field                 = field_mask_t(1) << 7,
+			      duration_field                    = field_mask_t(1) << 8,
+			      event_confirmation_required_field = field_mask_t(1) << 9,
+			      event_id_field                    = field_mask_t(1) << 10,
+			      id_field                          = field_mask_t(1) << 11,
+			      images_field                      = field_mask_t(1) << 12,
+			      name_field                        = field_mask_t(1) << 13,
+			      organizer_display_name_field      = field_mask_t(1) << 14,
+			      organizer_field                   = field_mask_t(1) << 15,
+			      owner_field                       = field_mask_t(1) << 16,
+			      position_field                    = field_mask_t(1) << 17,
+			      private_field                     = field_mask_t(1) << 18,
+			      rating_field                      = field_mask_t(1) << 19,
+			      start_field                       = field_mask_t(1) << 20,
+			      state_field                       = field_mask_t(1) << 21,
+			      venue_id_field                    = field_mask_t(1) << 22,
+			      venue_name_field                  = field_mask_t(1) << 23,
+			      venue_field                       = field_mask_t(1) << 24
+  };
+
+  constexpr field_mask_t all_fields = 0;
+
+  constexpr bool requested(field_mask_t m, field_t f){ return !m || (m & f); }
+
+  // Search chunks.
+  // Searches can return up to the search limit of results, all turned into payloads before the reply is sent. A query
+  // can instead ask for a chunk of "count" results starting at "first". Only the results in the chunk are turned into
+  // payloads, and the reply gives the "first" of the next chunk, or 0 if there is none. The App can then display the
+  // first results early and fetch the rest as needed. A null count means all the results, as for older Apps.
+  // The results are numbered in the order the kdcache returns them, before events which are not bookable are filtered
+  // out. That order is stable as long as the kdcache is not refreshed between two chunks.
+  struct search_chunk
+  {
+    template <typename Query>
+    search_chunk(const rfr<Query>& q):
+      first(q->first),
+      end(q->count ? q->first + q->count : ::std::numeric_limits<uint64_t>::max())
+    {
+    }
+
+    bool before(uint64_t n) const { return n < first; }
+
+    bool after(uint64_t n) const { return n >= end; }
+
+    uint64_t first;
+    uint64_t end;
+  };
+
+  // The documents payloads obtain by following the links of a venue or of an event. Following a link means getting a
+  // document from the database. Searches share them between the results of a request linking to the same documents,
+  // i.e., events at the same venue. Payload constructors follow the links themselves when not supplied these.
+  // Only the links shared are there. The organizer and the conversation of an event are its own, payloads follow them
+  // when their fields are requested.
+
+  struct venue_links
+  {
+    venue_links(const venue_r& v):
+      venue(v)
+    {
+    }
+
+    // Followed the first time it is needed.
+    user_r get_owner() const {
+      if (!owner){
+	owner = venue->get_owner();
+      }
+
+      return *owner;
+    }
+
+    venue_r venue;
+    mutable user_p owner;
+  };
+
+  struct event_links
+  {
+    // The venue links are the ones of the event's venue.
+    event_links(const venue_links& vl):
+      venue(vl.venue),
+      of_venue(vl)
+    {
+    }
+
+    venue_r venue;
+    const venue_links& of_venue;
+  };
+
+  // The fields requiring event links.
+  constexpr field_mask_t event_links_fields =
+    position_field |
+    venue_id_field |
+    venue_name_field |
+    venue_field;
+
+  constexpr bool requested_links(field_mask_t m, field_mask_t links_fields){ return !m || (m & links_fields); }
+
   class min_app_version_payload: public element<>
   {
     HX2A_ELEMENT(min_app_version_payload, type_tag<"min_app_version_pld">, element,
@@ -206,6 +392,20 @@ namespace events {
     slot<double> _min_app_version;
   };
 
+  class count_payload: public element<>
+  {
+    HX2A_ELEMENT(count_payload, type_tag<"count_pld">, element,
+		 ((count, count_tag)));
+  public:
+
+    count_payload(size_t c):
+      count(*this, c)
+    {
+    }
+
+    slot<size_t> count;
+  };
+
   class user_data_payload: public element<>
   {
     HX2A_ELEMENT(user_data_payload, type_tag<"user_data_pld">, element,
@@ -304,20 +504,46 @@ namespace events {
     {
     }
 
-    venue_data_payload(const venue_r& v):
-      query_name(v->get_name()),
-      owner(*this, make<user_data_payload>(v->get_owner())),
+    // Only the fields requested by the mask are calculated. See sparse fieldsets above.
+    // The links can be supplied when already known.
+    venue_data_payload(const venue_r& v, field_mask_t m = all_fields, const venue_links* l = nullptr):
+      query_name(requested(m, name_field) ? v->get_name() : string()),
+      owner(*this),
       is_private(*this, v->is_private()),
       category(*this, v->get_category()),
-      category_description(*this, v->get_category_description()),
-      pos(*this, v->get_position()->copy()),
-      addr(*this, v->get_address()->copy()),
+      category_description(*this),
+      pos(*this),
+      addr(*this),
       capacity(*this, v->get_capacity()),
-      description(*this, v->get_description()),
+      description(*this),
       event_confirmation_required(*this, v->get_event_confirmation_required()),
       images(*this),
       rating(*this, v->get_rating())
     {
+      if (requested(m, owner_field)){
+	owner = make<user_data_payload>(l ? l->get_owner() : v->get_owner());
+      }
+
+      if (requested(m, category_description_field)){
+	category_description = v->get_category_description();
+      }
+
+      if (requested(m, position_field)){
+	pos = v->get_position()->copy();
+      }
+
+      if (requested(m, address_field)){
+	addr = v->get_address()->copy();
+      }
+
+      if (requested(m, description_field)){
+	description = v->get_description();
+      }
+
+      if (!requested(m, images_field)){
+	return;
+      }
+      
       const venue::images_type& im = v->get_images();
       // This should be replaced by a reserve followed by a std::copy with back_inserter when it compiles.
       images.resize(im.size());
@@ -374,6 +600,32 @@ namespace events {
     slot<doc_id> venue_id;
   };
   
+  // Conditional get, see etag.hpp.
+  class venue_get_payload: public venue_id_payload
+  {
+    HX2A_ELEMENT(venue_get_payload, type_tag<"venue_get_pld">, venue_id_payload,
+		 ((etag, etag_tag)));
+  public:
+
+    // Empty if the client has no copy.
+    slot<string> etag;
+  };
+
+  class venue_data_with_etag_payload: public venue_data_payload
+  {
+    HX2A_ELEMENT(venue_data_with_etag_payload, type_tag<"venue_data_with_etag_pld">, venue_data_payload,
+		 ((etag, etag_tag)));
+  public:
+
+    venue_data_with_etag_payload(const venue_r& v, const string& t):
+      venue_data_payload(v),
+      etag(*this, t)
+    {
+    }
+    
+    slot<string> etag;
+  };
+  
   class venue_claim_data_payload: public element<>
   {
     HX2A_ELEMENT(venue_claim_data_payload, type_tag<"venue_claim_data_pld">, element,
@@ -464,10 +716,13 @@ namespace events {
 		 ((id, id_tag)));
   public:
 
-    venue_search_data_payload(const venue_r& v):
-      venue_data_payload(v),
-      id(*this, v->get_id())
+    venue_search_data_payload(const venue_r& v, field_mask_t m = all_fields, const venue_links* l = nullptr):
+      venue_data_payload(v, m, l),
+      id(*this)
     {
+      if (requested(m, id_field)){
+	id = v->get_id();
+      }
     }
 
     slot<doc_id> id;
@@ -476,10 +731,18 @@ namespace events {
   class venue_search_query: public area
   {
     HX2A_ELEMENT(venue_search_query, type_tag<"venue_search_query">, area,
-		 ((categories, categories_tag)));
+		 ((categories, categories_tag),
+		  (fields, fields_tag),
+		  (first, first_tag),
+		  (count, count_tag)));
   public:
     
     slot_vector<category_t> categories;
+    // Null means all fields.
+    slot<field_mask_t> fields;
+    // Chunk of the search results to return, see search chunks below.
+    slot<uint64_t> first;
+    slot<uint64_t> count;
   };
   
   class venue_search_reply: public element<>
@@ -490,7 +753,8 @@ namespace events {
 
     // Created empty, and getting venues data pushed.
     venue_search_reply():
-      venues(*this)
+      venues(*this),
+      next(*this, 0)
     {
     }
 
@@ -498,7 +762,11 @@ namespace events {
       venues.push_back(vd);
     }
 
+    void set_next(uint64_t n){ next = n; }
+
     own_list<venue_search_data_payload> venues;
+    // First result of the next chunk. Null if there is none.
+    slot<uint64_t> next;
   };
 
   // Event-related payloads.
@@ -547,19 +815,38 @@ namespace events {
     {
     }
 
-    event_create_payload(const event_r& ev):
-      query_name(ev->get_name()),
-      venue_id(*this, ev->get_venue()->get_id()),
+    // Only the fields requested by the mask are calculated. See sparse fieldsets above.
+    // The links can be supplied when already known.
+    event_create_payload(const event_r& ev, field_mask_t m = all_fields, const event_links* l = nullptr):
+      query_name(requested(m, name_field) ? ev->get_name() : string()),
+      venue_id(*this),
       is_private(*this, ev->is_private()),
       category(*this, ev->get_category()),
-      category_description(*this, ev->get_category_description()),
+      category_description(*this),
       capacity(*this, ev->get_capacity()),
       start(*this, ev->get_start()),
       duration(*this, ev->get_duration()),
       bookings_notice_time(*this, ev->get_bookings_notice_time()),
-      organizer_display_name(*this, ev->get_organizer_display_name()),
+      organizer_display_name(*this),
       images(*this)
     {
+      if (requested(m, venue_id_field)){
+	venue_id = (l ? l->venue : ev->get_venue())->get_id();
+      }
+
+      if (requested(m, category_description_field)){
+	category_description = ev->get_category_description();
+      }
+
+      if (requested(m, organizer_display_name_field)){
+	// Follows the conversation link.
+	organizer_display_name = ev->get_organizer_display_name();
+      }
+
+      if (!requested(m, images_field)){
+	return;
+      }
+      
       const event::images_type& im = ev->get_images();
       // This should be replaced by a reserve followed by a std::copy with back_inserter when it compiles.
       images.resize(im.size());
@@ -606,15 +893,37 @@ namespace events {
 		  (bookable, bookable_tag)));
   public:
 
-    event_data_payload(const event_r& e):
-      event_create_payload(e),
-      organizer(*this, make<user_data_payload>(e->get_organizer())),
-      venue_name(*this, e->get_venue()->get_name()),
-      venue_data(*this, make<venue_data_payload>(e->get_venue())),
+    // Only the fields requested by the mask are calculated. See sparse fieldsets above.
+    // The links can be supplied when already known.
+    event_data_payload(const event_r& e, field_mask_t m = all_fields, const event_links* l = nullptr):
+      event_create_payload(e, m, l),
+      organizer(*this),
+      venue_name(*this),
+      venue_data(*this),
       state(*this, e->get_state()),
       conversation_id(*this),
-      bookable(*this, e->is_bookable())
+      bookable(*this, requested(m, bookable_field) && e->is_bookable())
     {
+      if (requested(m, organizer_field)){
+	organizer = make<user_data_payload>(e->get_organizer());
+      }
+
+      if (requested(m, venue_name_field)){
+	venue_name = (l ? l->venue : e->get_venue())->get_name();
+      }
+
+      if (requested(m, venue_field)){
+	venue_data = l ? make<venue_data_payload>(l->venue, all_fields, &l->of_venue) : make<venue_data_payload>(e->get_venue());
+      }
+      // The position of an event is the one of its venue. The App pins only need that.
+      else if (requested(m, position_field)){
+	venue_data = make<venue_data_payload>(l ? l->venue : e->get_venue(), position_field);
+      }
+
+      if (!requested(m, conversation_id_field)){
+	return;
+      }
+
       if (messenger::conversation_p conv = e->get_conversation()){
 	conversation_id = (*conv)->get_id();
       }
@@ -647,6 +956,32 @@ namespace events {
     slot<doc_id> event_id;
   };
   
+  // Conditional get, see etag.hpp.
+  class event_get_payload: public event_id_payload
+  {
+    HX2A_ELEMENT(event_get_payload, type_tag<"event_get_pld">, event_id_payload,
+		 ((etag, etag_tag)));
+  public:
+
+    // Empty if the client has no copy.
+    slot<string> etag;
+  };
+
+  class event_data_with_etag_payload: public event_data_payload
+  {
+    HX2A_ELEMENT(event_data_with_etag_payload, type_tag<"event_data_with_etag_pld">, event_data_payload,
+		 ((etag, etag_tag)));
+  public:
+
+    event_data_with_etag_payload(const event_r& e, const string& t):
+      event_data_payload(e),
+      etag(*this, t)
+    {
+    }
+    
+    slot<string> etag;
+  };
+  
   class event_details_payload: public element<>
   {
     HX2A_ELEMENT(event_details_payload, type_tag<"event_details_pld">, element,
@@ -859,10 +1194,13 @@ namespace events {
 		 ((event_id, event_id_tag)));
   public:
 
-    event_search_data_payload(const event_r& e):
-      event_data_payload(e),
-      event_id(*this, e->get_id())
+    event_search_data_payload(const event_r& e, field_mask_t m = all_fields, const event_links* l = nullptr):
+      event_data_payload(e, m, l),
+      event_id(*this)
     {
+      if (requested(m, event_id_field)){
+	event_id = e->get_id();
+      }
     }
 
     slot<doc_id> event_id;
@@ -876,7 +1214,8 @@ namespace events {
 
     // Created empty, and getting events data pushed.
     event_search_reply():
-      events(*this)
+      events(*this),
+      next(*this, 0)
     {
     }
 
@@ -884,7 +1223,11 @@ namespace events {
       events.push_back(vd);
     }
 
+    void set_next(uint64_t n){ next = n; }
+
     own_list<event_search_data_payload> events;
+    // First result of the next chunk. Null if there is none.
+    slot<uint64_t> next;
   };
 
   class event_search_query: public element<>
@@ -892,26 +1235,63 @@ namespace events {
     HX2A_ELEMENT(event_search_query, type_tag<"event_search_pld">, element,
 		 ((the_area, area_tag),
 		  (the_period, start_tag),
-		  (categories, categories_tag)));
+		  (categories, categories_tag),
+		  (fields, fields_tag),
+		  (first, first_tag),
+		  (count, count_tag)));
   public:
 
     own<area> the_area;
     // This is an interval for the start.
     own<period> the_period;
     slot_vector<category_t> categories;
+    // Null means all fields.
+    slot<field_mask_t> fields;
+    // Chunk of the search results to return, see search chunks below.
+    slot<uint64_t> first;
+    slot<uint64_t> count;
+  };
+
+  // Compact projection for the App map pins, for paginated listings which cannot take a fields mask.
+  class event_pin_payload: public event_id_payload
+  {
+    HX2A_ELEMENT(event_pin_payload, type_tag<"event_pin_pld">, event_id_payload,
+		 ((name, name_tag),
+		  (category, category_tag),
+		  (start, start_tag),
+		  (pos, position_tag)));
+  public:
+
+    event_pin_payload(const event_r& e):
+      event_id_payload(e),
+      name(*this, e->get_name()),
+      category(*this, e->get_category()),
+      start(*this, e->get_start()),
+      pos(*this, e->get_position()->copy())
+    {
+    }
+
+    slot<string> name;
+    slot<category_t> category;
+    slot<time_t> start;
+    own<position> pos;
   };
 
   class open_invite_data_payload: public element<>
   {
     HX2A_ELEMENT(open_invite_data_payload, type_tag<"open_invite_data_pld">, element,
-		 ((contacts, contacts_tag)));
+		 ((contacts, contacts_tag),
+		  (count, count_tag)));
   public:
 
     open_invite_data_payload(const open_invite_r&);
 
   private:
 
+    // Only the contacts held inline.
     own_vector<contact> contacts;
+    // All the contacts, including the ones stored outside of the open invite.
+    slot<size_t> count;
   };
   
   class open_invite_create_payload: public element<>
@@ -941,6 +1321,31 @@ namespace events {
     slot<string> last_name;
   };
   
+  class open_invite_add_contacts_payload: public element<>
+  {
+    HX2A_ELEMENT(open_invite_add_contacts_payload, type_tag<"open_invite_add_contacts_pld">, element,
+		 ((invite_id, invite_id_tag),
+		  (contacts, contacts_tag)));
+  public:
+
+    slot<doc_id> invite_id;
+    own_vector<contact> contacts;
+  };
+
+  class guest_ids_payload: public element<>
+  {
+    HX2A_ELEMENT(guest_ids_payload, type_tag<"guest_ids_pld">, element,
+		 ((guest_ids, guest_ids_tag)));
+  public:
+
+    guest_ids_payload():
+      guest_ids(*this)
+    {
+    }
+    
+    slot_vector<doc_id> guest_ids;
+  };
+  
   class invite_create_payload: public element<>
   {
     HX2A_ELEMENT(invite_create_payload, type_tag<"invite_create_pld">, element,
@@ -958,6 +1363,31 @@ namespace events {
     slot<doc_id> guest_id;
   };
   
+  class invites_create_payload: public element<>
+  {
+    HX2A_ELEMENT(invites_create_payload, type_tag<"invites_create_pld">, element,
+		 ((event_id, event_id_tag),
+		  (guest_ids, guest_ids_tag)));
+  public:
+
+    slot<doc_id> event_id;
+    slot_vector<doc_id> guest_ids;
+  };
+  
+  class invite_ids_payload: public element<>
+  {
+    HX2A_ELEMENT(invite_ids_payload, type_tag<"invite_ids_pld">, element,
+		 ((invite_ids, invite_ids_tag)));
+  public:
+
+    invite_ids_payload():
+      invite_ids(*this)
+    {
+    }
+    
+    slot_vector<doc_id> invite_ids;
+  };
+  
   class open_invite_id_payload: public element<>
   {
     HX2A_ELEMENT(open_invite_id_payload, type_tag<"open_invite_id_pld">, element,
@@ -1033,6 +1463,11 @@ namespace events {
     {
     }
     
+    invite_details_payload(const open_invite_contact_r& c):
+      invite_details_payload(c->get_open_invite())
+    {
+    }
+    
     own<user_data_payload> host;
     own<event_details_payload> event_details;
     slot<time_t> invite_creation_time;
@@ -1076,6 +1511,60 @@ namespace events {
     slot<doc_id> booking_id;
   };
 
+  class book_reply_payload: public element<>
+  {
+    HX2A_ELEMENT(book_reply_payload, type_tag<"book_reply_pld">, element,
+		 ((booking_id, booking_id_tag),
+		  (retry_after, retry_after_tag)));
+  public:
+
+    book_reply_payload(const booking_r& b):
+      booking_id(*this, b->get_id()),
+      retry_after(*this, 0)
+    {
+    }
+
+    // Not booked, the bookings of the event are paced. The number of seconds to wait before booking again.
+    book_reply_payload(time_t t):
+      booking_id(*this),
+      retry_after(*this, t)
+    {
+    }
+    
+    slot<doc_id> booking_id;
+    // In seconds. Null if booked.
+    slot<time_t> retry_after;
+  };
+
+  class seat_hold_expiry_payload: public element<>
+  {
+    HX2A_ELEMENT(seat_hold_expiry_payload, type_tag<"seat_hold_expiry_pld">, element,
+		 ((expiry_timestamp, expiry_timestamp_tag)));
+  public:
+
+    seat_hold_expiry_payload(time_t t):
+      expiry_timestamp(*this, t)
+    {
+    }
+
+    slot<time_t> expiry_timestamp;
+  };
+
+  // In seconds. Null means now.
+  class retry_after_payload: public element<>
+  {
+    HX2A_ELEMENT(retry_after_payload, type_tag<"retry_after_pld">, element,
+		 ((retry_after, retry_after_tag)));
+  public:
+
+    retry_after_payload(time_t t):
+      retry_after(*this, t)
+    {
+    }
+
+    slot<time_t> retry_after;
+  };
+
   class booking_data_payload: public element<>
   {
     HX2A_ELEMENT(booking_data_payload, type_tag<"booking_data_pld">, element,
@@ -1153,6 +1642,32 @@ namespace events {
     own<event_data_payload> event_data;
   };
 
+  // Conditional get, see etag.hpp.
+  class booking_get_payload: public booking_id_payload
+  {
+    HX2A_ELEMENT(booking_get_payload, type_tag<"booking_get_pld">, booking_id_payload,
+		 ((etag, etag_tag)));
+  public:
+
+    // Empty if the client has no copy.
+    slot<string> etag;
+  };
+
+  class booking_and_event_data_with_etag_payload: public booking_and_event_data_payload
+  {
+    HX2A_ELEMENT(booking_and_event_data_with_etag_payload, type_tag<"booking_and_event_data_with_etag_pld">, booking_and_event_data_payload,
+		 ((etag, etag_tag)));
+  public:
+
+    booking_and_event_data_with_etag_payload(const booking_r& b, const string& t):
+      booking_and_event_data_payload(b),
+      etag(*this, t)
+    {
+    }
+    
+    slot<string> etag;
+  };
+
   class booking_and_user_data_payload: public booking_data_payload
   {
     HX2A_ELEMENT(booking_and_user_data_payload, type_tag<"booking_and_user_data_pld">, booking_data_payload,
@@ -1239,6 +1754,64 @@ namespace events {
     slot<time_t> expiry_timestamp;
   };
 
+  // Calculated from the agenda item alone. The event details are obtained with a conditional get.
+  class agenda_item_data_payload: public element<>
+  {
+    HX2A_ELEMENT(agenda_item_data_payload, type_tag<"agenda_item_data_pld">, element,
+		 ((id, id_tag),
+		  (kind, kind_tag),
+		  (event_id, event_id_tag),
+		  (event_name, event_name_tag),
+		  (event_start, event_start_tag)));
+  public:
+
+    agenda_item_data_payload(const agenda_item_r& ai):
+      id(*this, ai->get_item_id()),
+      kind(*this, ai->get_kind()),
+      event_id(*this, ai->get_event_id()),
+      event_name(*this, ai->get_event_name()),
+      event_start(*this, ai->get_event_start())
+    {
+    }
+
+    // The booking or invite document identifier.
+    slot<doc_id> id;
+    slot<agenda_item::kind_t> kind;
+    slot<doc_id> event_id;
+    slot<string> event_name;
+    slot<time_t> event_start;
+  };
+
+  // For the Apps to remove documents from their lists when synchronizing them incrementally.
+  class removal_data_payload: public element<>
+  {
+    HX2A_ELEMENT(removal_data_payload, type_tag<"removal_data_pld">, element,
+		 ((id, id_tag),
+		  (kind, kind_tag),
+		  (timestamp, timestamp_tag)));
+  public:
+
+    removal_data_payload(const removal_r& r):
+      id(*this, r->get_removed_id()),
+      kind(*this, r->get_kind()),
+      timestamp(*this, r->get_creation_time())
+    {
+    }
+
+    slot<doc_id> id;
+    slot<removal::kind_t> kind;
+    slot<time_t> timestamp;
+  };
+
+  class timestamp_payload: public element<>
+  {
+    HX2A_ELEMENT(timestamp_payload, type_tag<"timestamp_pld">, element,
+		 ((timestamp, timestamp_tag)));
+  public:
+
+    slot<time_t> timestamp;
+  };
+
 } // End namespace events.
 
 #endif
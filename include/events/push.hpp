@@ -0,0 +1,122 @@
+//
+// Copyright Metaspex - 2024
+// mailto:admin@metaspex.com
+//
+
+#ifndef EVENTS_PUSH_HPP
+#define EVENTS_PUSH_HPP
+
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "hx2a/root.hpp"
+
+namespace events {
+
+  using namespace hx2a;
+
+  // Push messages to devices through Expo, accumulated across invites and users and flushed by batches of up to 100
+  // messages, the maximum Expo accepts in one request.
+  // The batching is in-process only: the Expo notifier sends one message per request, the batches only bound the work
+  // between two log lines. What saves requests is the coalescing: messages are coalesced by user, token and kind until
+  // flushed, a user with several client states for the same token gets one message, and a burst of invites for the
+  // same user becomes a single summarized message.
+  // Each message remembers the sources it was added for, e.g., notifications, so that they can be retried if it fails.
+  // The messages left are sent on destruction.
+  class push_batcher
+  {
+  public:
+
+    static constexpr size_t batch_size = 100;
+
+    enum kind_t {
+		 invite_push = 0
+    };
+
+    // Outcome of the messages sent.
+    struct receipt
+    {
+      size_t sent = 0;
+      size_t failed = 0;
+    };
+
+    push_batcher() = default;
+
+    push_batcher(const push_batcher&) = delete;
+
+    push_batcher& operator=(const push_batcher&) = delete;
+
+    ~push_batcher(){
+      flush();
+    }
+
+    // The item is what the message is about, e.g., an invite. The same item is counted once.
+    // The source is what the message is sent for, null if nothing is to be retried.
+    void add(const doc_id& user_id, const string& token, kind_t k, const doc_id& item_id, const string& title, const doc_id& source){
+      auto [i, inserted] = _indexes.try_emplace({user_id, token, k}, _messages.size());
+
+      if (inserted){
+	_messages.push_back({token, k, title, item_id, 1, {}});
+      }
+      else{
+	message& m = _messages[i->second];
+	
+	// An item's messages are added together, comparing with the last one is enough.
+	if (m.last_item_id != item_id){
+	  m.last_item_id = item_id;
+	  ++m.count;
+	}
+      }
+
+      if (!source.is_null()){
+	_messages[i->second].sources.insert(source);
+      }
+    }
+
+    // Sends the messages accumulated so far, by batches. Failures are counted and their sources recorded, not thrown.
+    void flush();
+
+    // Tells whether a message added for the source failed in the flushes so far.
+    bool has_failed(const doc_id& source) const { return _failed_sources.find(source) != _failed_sources.cend(); }
+
+    // All the items coalesced into another's message by the batcher so far.
+    size_t get_coalesced_count() const { return _coalesced; }
+
+    // All the messages sent by the batcher so far.
+    const receipt& get_total() const { return _total; }
+
+  private:
+
+    struct message
+    {
+      string token;
+      kind_t kind;
+      // The one of the first item.
+      string title;
+      doc_id last_item_id;
+      // Number of items.
+      size_t count;
+      ::std::set<doc_id> sources;
+    };
+
+    using key_type = ::std::tuple<doc_id, string, kind_t>;
+
+    // Sends at most a batch.
+    receipt send(::std::vector<message>::const_iterator, ::std::vector<message>::const_iterator);
+
+    static string summarize(const message&);
+
+    ::std::vector<message> _messages;
+    // Indexes of the messages in the vector above.
+    ::std::map<key_type, size_t> _indexes;
+    receipt _total;
+    size_t _coalesced = 0;
+    ::std::set<doc_id> _failed_sources;
+  };
+
+} // End namespace events.
+
+#endif
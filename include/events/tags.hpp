@@ -10,6 +10,10 @@
 #include "hx2a/service_name.hpp"
 
 // List of "readable" tags for payloads. Enforces reuse and consistency.
+// The tags are the keys of the payload fields whatever the encoding of the replies. Replies are encoded by the HX2A
+// server layer and the application never sees the bytes, so a binary encoding (e.g., CBOR) negotiated on the Accept
+// header belongs there. Payloads should not assume JSON beyond the tags. Clients wanting smaller replies can use the
+// fields masks and the chunks of the searches.
 
 namespace events {
 
@@ -40,11 +44,13 @@ namespace events {
   constexpr tag_t confirmed_tag                           = "confirmed";
   constexpr tag_t contacts_tag                            = "contacts";
   constexpr tag_t conversation_id_tag                     = "conversation_id";
+  constexpr tag_t count_tag                               = "count";
   constexpr tag_t description_tag                         = "description";
   constexpr tag_t display_name_tag                        = "display_name";
   constexpr tag_t duration_tag                            = "duration";
   constexpr tag_t email_tag                               = "email";
   constexpr tag_t end_tag                                 = "end";
+  constexpr tag_t etag_tag                                = "etag";
   constexpr tag_t event_confirmation_required_tag         = "event_conf_req";
   constexpr tag_t event_id_tag                            = "event_id";
   constexpr tag_t event_name_tag                          = "event_name";
@@ -52,19 +58,25 @@ namespace events {
   constexpr tag_t event_tag                               = "event";
   constexpr tag_t events_tag                              = "events";
   constexpr tag_t expiry_timestamp_tag                    = "expiry";
+  constexpr tag_t fields_tag                              = "fields";
+  constexpr tag_t first_tag                               = "first";
   constexpr tag_t first_name_tag                          = "first_name";
   constexpr tag_t guest_id_tag                            = "guest_id";
+  constexpr tag_t guest_ids_tag                           = "guest_ids";
   constexpr tag_t guest_tag                               = "guest";
   constexpr tag_t host_tag                                = "host";
   constexpr tag_t id_tag                                  = "id";
   constexpr tag_t images_tag                              = "images";
   constexpr tag_t invite_creation_time_tag                = "ct";
   constexpr tag_t invite_id_tag                           = "invite_id";
+  constexpr tag_t invite_ids_tag                          = "invite_ids";
+  constexpr tag_t kind_tag                                = "kind";
   constexpr tag_t last_name_tag                           = "last_name";
   constexpr tag_t messenger_participation_id_tag          = "msg_partid";
   constexpr tag_t name_tag                                = "name";
   constexpr tag_t new_owner_id_tag                        = "new_owner_id";
   constexpr tag_t news_id_tag                             = "news_id";
+  constexpr tag_t next_tag                                = "next";
   constexpr tag_t note_tag                                = "note";
   constexpr tag_t organizer_display_name_tag              = "organizer_dn";
   constexpr tag_t organizer_tag                           = "organizer";
@@ -74,6 +86,7 @@ namespace events {
   constexpr tag_t rating_tag                              = "rating";
   constexpr tag_t reason_tag                              = "reason";
   constexpr tag_t report_count_tag                        = "report_count";
+  constexpr tag_t retry_after_tag                         = "retry_after";
   constexpr tag_t start_tag                               = "start";
   constexpr tag_t state_tag                               = "state";
   constexpr tag_t text_tag                                = "text";
@@ -8,16 +8,90 @@
 #include "hx2a/time.hpp"
 #include "hx2a/format.hpp"
 
-#include "hx2a/http/expo.hpp"
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <random>
+#include <vector>
 
+#include "events/admission.hpp"
 #include "events/client_state.hpp"
 #include "events/exception.hpp"
+#include "events/hash.hpp"
 #include "events/ontology.hpp"
 
 namespace events {
 
   using namespace hx2a;
 
+  namespace {
+
+    // Sums of the sharded booking counters of events, so that displaying events does not get all their counters.
+    class booking_counts_cache
+    {
+    public:
+
+      template <typename F>
+      capacity_t get(const doc_id& event_id, F calculate){
+	time_t now = time();
+
+	{
+	  ::std::lock_guard<::std::mutex> l(_mutex);
+	  auto i = _entries.find(event_id);
+
+	  if (i != _entries.end() && now - i->second.calculation_time < time_t(get_booking_counts_max_age())){
+	    return i->second.count;
+	  }
+	}
+
+	// Calculated outside of the lock, it gets documents.
+	capacity_t c = calculate();
+	::std::lock_guard<::std::mutex> l(_mutex);
+
+	// Crude but bounded.
+	if (_entries.size() >= get_booking_counts_cache_limit()){
+	  _entries.clear();
+	}
+	
+	_entries[event_id] = {c, now};
+	return c;
+      }
+
+    private:
+
+      struct entry
+      {
+	capacity_t count;
+	time_t calculation_time;
+      };
+
+      ::std::mutex _mutex;
+      ::std::map<doc_id, entry> _entries;
+    };
+
+    booking_counts_cache& get_booking_counts_cache(){
+      // Statics are thread-safe.
+      static booking_counts_cache c;
+      return c;
+    }
+
+    // Identifies the worker in the notifications it claims.
+    const doc_id& get_worker_id(){
+      // Statics are thread-safe.
+      static const doc_id id = []{
+	::std::random_device rd;
+	return derived_doc_id("w", hasher().add(uint64_t(rd()) << 32 | rd()).add(uint64_t(time())).str());
+      }();
+      return id;
+    }
+
+    // Share of the shard in an amount spread over the shards.
+    booking_counter::count_t share(size_t amount, size_t shards, size_t shard){
+      return booking_counter::count_t(amount / shards + (shard < amount % shards ? 1 : 0));
+    }
+    
+  } // namespace
+
   double get_min_app_version(){
     // static as a cache.
     static double v = config::get_number_or(min_app_version_name,
@@ -39,6 +113,40 @@ namespace events {
     return v;
   }
   
+  time_t get_derived_booking_ids_since(){
+    // static as a cache.
+    static time_t v = config::get_number_or(derived_booking_ids_since_name,
+					    default_derived_booking_ids_since);
+    return v;
+  }
+  
+  time_t get_derived_invite_ids_since(){
+    // static as a cache.
+    static time_t v = config::get_number_or(derived_invite_ids_since_name,
+					    default_derived_invite_ids_since);
+    return v;
+  }
+  
+  size_t get_access_cache_max_age(){
+    // static as a cache.
+    static size_t v = config::get_number_or(access_cache_max_age_name,
+					    default_access_cache_max_age);
+    return v;
+  }
+  
+  size_t get_access_cache_limit(){
+    // static as a cache.
+    static size_t v = config::get_number_or(access_cache_limit_name,
+					    default_access_cache_limit);
+    return v;
+  }
+  
+  access_cache& get_access_cache(){
+    // Statics are thread-safe.
+    static access_cache c;
+    return c;
+  }
+  
   size_t get_contacts_in_open_invite_limit(){
     // static as a cache.
     static size_t v = config::get_number_or(contacts_in_open_invite_limit_name,
@@ -46,30 +154,659 @@ namespace events {
     return v;
   }
   
+  size_t get_stored_contacts_in_open_invite_limit(){
+    // static as a cache.
+    static size_t v = config::get_number_or(stored_contacts_in_open_invite_limit_name,
+					    default_stored_contacts_in_open_invite_limit);
+    return v;
+  }
+  
+  size_t get_contacts_in_bulk_limit(){
+    // static as a cache.
+    static size_t v = config::get_number_or(contacts_in_bulk_limit_name,
+					    default_contacts_in_bulk_limit);
+    return v;
+  }
+  
+  size_t get_invites_in_bulk_limit(){
+    // static as a cache.
+    static size_t v = config::get_number_or(invites_in_bulk_limit_name,
+					    default_invites_in_bulk_limit);
+    return v;
+  }
+  
+  size_t get_booking_shards(){
+    // static as a cache.
+    static size_t v = config::get_number_or(booking_shards_name,
+					    default_booking_shards);
+    return v;
+  }
+  
+  size_t get_booking_counts_max_age(){
+    // static as a cache.
+    static size_t v = config::get_number_or(booking_counts_max_age_name,
+					    default_booking_counts_max_age);
+    return v;
+  }
+
+  size_t get_booking_counts_cache_limit(){
+    // static as a cache.
+    static size_t v = config::get_number_or(booking_counts_cache_limit_name,
+					    default_booking_counts_cache_limit);
+    return v;
+  }
+  
+  bool get_seat_documents(){
+    // static as a cache.
+    static bool v = config::get_number_or(seat_documents_name,
+					  default_seat_documents);
+    return v;
+  }
+  
+  size_t get_seat_probes_limit(){
+    // static as a cache.
+    static size_t v = config::get_number_or(seat_probes_limit_name,
+					    default_seat_probes_limit);
+    return v;
+  }
+  
+  size_t get_seat_hold_duration(){
+    // static as a cache.
+    static size_t v = config::get_number_or(seat_hold_duration_name,
+					    default_seat_hold_duration);
+    return v;
+  }
+  
+  size_t get_seat_holds_sweep_minutes(){
+    // static as a cache.
+    static size_t v = config::get_number_or(seat_holds_sweep_minutes_name,
+					    default_seat_holds_sweep_minutes);
+    return v;
+  }
+  
+  size_t get_admission_rate(){
+    // static as a cache.
+    static size_t v = config::get_number_or(admission_rate_name,
+					    default_admission_rate);
+    return v;
+  }
+  
+  size_t get_admission_burst(){
+    // static as a cache.
+    static size_t v = config::get_number_or(admission_burst_name,
+					    default_admission_burst);
+    return v;
+  }
+  
+  size_t get_admission_limit(){
+    // static as a cache.
+    static size_t v = config::get_number_or(admission_limit_name,
+					    default_admission_limit);
+    return v;
+  }
+
+  size_t get_admission_grace(){
+    // static as a cache.
+    static size_t v = config::get_number_or(admission_grace_name,
+					    default_admission_grace);
+    return v;
+  }
+
+  admission_control& get_admission_control(){
+    // Statics are thread-safe.
+    static admission_control a;
+    return a;
+  }
+  
+  bool get_notifications_outbox(){
+    // static as a cache.
+    static bool v = config::get_number_or(notifications_outbox_name,
+					  default_notifications_outbox);
+    return v;
+  }
+  
+  size_t get_notifications_drain_limit(){
+    // static as a cache.
+    static size_t v = config::get_number_or(notifications_drain_limit_name,
+					    default_notifications_drain_limit);
+    return v;
+  }
+  
+  size_t get_notification_retry_delay(){
+    // static as a cache.
+    static size_t v = config::get_number_or(notification_retry_delay_name,
+					    default_notification_retry_delay);
+    return v;
+  }
+  
+  size_t get_notification_max_attempts(){
+    // static as a cache.
+    static size_t v = config::get_number_or(notification_max_attempts_name,
+					    default_notification_max_attempts);
+    return v;
+  }
+  
+  size_t get_notification_lease(){
+    // static as a cache.
+    static size_t v = config::get_number_or(notification_lease_name,
+					    default_notification_lease);
+    return v;
+  }
+  
+  size_t get_notifications_drain_lookback(){
+    // static as a cache.
+    static size_t v = config::get_number_or(notifications_drain_lookback_name,
+					    default_notifications_drain_lookback);
+    return v;
+  }
+  
+  size_t get_client_state_max_idle(){
+    // static as a cache.
+    static size_t v = config::get_number_or(client_state_max_idle_name,
+					    default_client_state_max_idle);
+    return v;
+  }
+  
+  size_t get_client_state_sweep_days(){
+    // static as a cache.
+    static size_t v = config::get_number_or(client_state_sweep_days_name,
+					    default_client_state_sweep_days);
+    return v;
+  }
+  
+  size_t get_removal_retention(){
+    // static as a cache.
+    static size_t v = config::get_number_or(removal_retention_name,
+					    default_removal_retention);
+    return v;
+  }
+  
+  size_t get_removal_sweep_days(){
+    // static as a cache.
+    static size_t v = config::get_number_or(removal_sweep_days_name,
+					    default_removal_sweep_days);
+    return v;
+  }
+  
   invite_p event::get_invite(const db::connector& cn, const user_r& u) const {
+    if (!may_have_guest(u)){
+      return {};
+    }
+
+    return lookup_invite(cn, u);
+  }
+
+  invite_p event::lookup_invite(const db::connector& cn, const user_r& u) const {
+    if (time_t since = get_derived_invite_ids_since()){
+      if (invite_p i = root_get<invite>(cn, invite::make_id(get_id(), u->get_id()))){
+	return i;
+      }
+
+      // Invites for events created before the switch can have random identifiers.
+      if (get_creation_time() >= since){
+	return {};
+      }
+    }
+    
     // Check for unicity, attempt to get 2 rows.
     cursor c = cursor_on_key<invite>(cn->get_index(invite::index_by_event_and_guest), {.key = {get_id(), u->get_id()}, .limit = 2});
     c.read_next();
     const auto& rs = c.get_rows();
-    const size_t rows_count = rs.size();
+
+    if (rs.empty()){
+      return {};
+    }
     
-    // No more than one invite per user. In optimized mode this check is removed because it can fail (unlikely concurrent creations of invites).
-    HX2A_ASSERT(rows_count <= 1);
+    // No more than one invite per user. Concurrent creations with random identifiers, before derived identifiers were
+    // switched on, can have left two. They are reported, not fatal, the first one is used.
+    if (rs.size() > 1){
+      HX2A_LOG(error) << "Event " << get_id() << " has several invites for user " << u->get_id() << ".";
+    }
 
-    return rows_count ? rs.front().get_doc() : invite_p{};
+    return rs.front().get_doc();
   }
 
   booking_p event::get_booking(const db::connector& cn, const user_r& u) const {
+    if (!may_have_guest(u)){
+      return {};
+    }
+
+    return lookup_booking(cn, u);
+  }
+
+  booking_p event::lookup_booking(const db::connector& cn, const user_r& u) const {
+    if (time_t since = get_derived_booking_ids_since()){
+      if (booking_p b = root_get<booking>(cn, booking::make_id(get_id(), u->get_id()))){
+	return b;
+      }
+
+      // Bookings for events created before the switch can have random identifiers.
+      if (get_creation_time() >= since){
+	return {};
+      }
+    }
+    
     // Check for unicity, attempt to get 2 rows.
     cursor c = cursor_on_key<booking>(cn->get_index(booking::index_by_event_and_guest), {.key = {get_id(), u->get_id()}, .limit = 2});
     c.read_next();
     const auto& rs = c.get_rows();
-    const size_t rows_count = rs.size();
+
+    if (rs.empty()){
+      return {};
+    }
     
-    // No more than one booking per user. In optimized mode this check is removed because it can fail (unlikely concurrent creations of bookings).
-    HX2A_ASSERT(rows_count <= 1);
+    // No more than one booking per user. Concurrent creations with random identifiers, before derived identifiers were
+    // switched on, can have left two. They are reported, not fatal, the first one is used.
+    if (rs.size() > 1){
+      HX2A_LOG(error) << "Event " << get_id() << " has several bookings for user " << u->get_id() << ".";
+    }
+
+    return rs.front().get_doc();
+  }
+
+  capacity_t event::get_bookings_count() const {
+    if (!_booking_shards){
+      return _bookings_count;
+    }
+
+    return get_booking_counts_cache().get(get_id(), [this]{
+      // No connector at hand, only when the cached count has expired.
+      db::connector cn{dbname};
+      return count_bookings(cn);
+    });
+  }
+
+  capacity_t event::count_bookings(const db::connector& cn) const {
+    if (!_booking_shards){
+      return _bookings_count;
+    }
+
+    size_t n = 0;
+
+    for (size_t s = 0; s != _booking_shards; ++s){
+      if (booking_counter_p bc = root_get<booking_counter>(cn, booking_counter::make_id(get_id(), s))){
+	n += (*bc)->get_count();
+      }
+    }
+
+    return capacity_t(n);
+  }
+
+  void event::shard_bookings(const db::connector& cn, size_t shards){
+    HX2A_ASSERT(!_booking_shards);
+    HX2A_ASSERT(!_bookings_count);
+    HX2A_ASSERT(shards);
+    _booking_shards = shards;
+    // Unknown.
+    _guests_filter.clear();
 
-    return rows_count ? rs.front().get_doc() : booking_p{};
+    for (size_t s = 0; s != shards; ++s){
+      make_derived<booking_counter>(cn, booking_counter::make_id(get_id(), s), *this, share(_capacity, shards, s));
+    }
+  }
+
+  void event::allot_booking_counters(const db::connector& cn){
+    ::std::vector<booking_counter_r> bcs;
+    size_t total = 0;
+
+    for (size_t s = 0; s != _booking_shards; ++s){
+      if (booking_counter_p bc = root_get<booking_counter>(cn, booking_counter::make_id(get_id(), s))){
+	total += (*bc)->get_count();
+	bcs.push_back(*bc);
+      }
+    }
+
+    // The capacity has been checked against the total.
+    size_t remaining = has_unlimited_capacity() ? 0 : _capacity - total;
+
+    for (size_t s = 0; s != bcs.size(); ++s){
+      bcs[s]->set_allotment(bcs[s]->get_count() + share(remaining, bcs.size(), s));
+    }
+  }
+
+  event::taken_seat event::book(const db::connector& cn, const user_r& guest){
+    if (!is_open_for_bookings()){
+      throw event_is_not_bookable();
+    }
+
+    if (seat_hold_p sh = seat_hold::get(cn, get_id(), guest)){
+      if (!(*sh)->is_expired(time())){
+	return (*sh)->use_seat();
+      }
+
+      // Not counted twice.
+      (*sh)->give_back();
+    }
+
+    return take_seat(cn, guest);
+  }
+
+  void event::unbook(const taken_seat& ts){
+    if (is_in_window()){
+      throw too_late();
+    }
+
+    give_back_seat(ts);
+  }
+
+  bool event::is_bookable_by(const db::connector& cn, const user_r& u){
+    if (!is_open_for_bookings()){
+      return false;
+    }
+
+    if (is_bookable()){
+      return true;
+    }
+
+    if (seat_hold_p sh = seat_hold::get(cn, get_id(), u); sh && !(*sh)->is_expired(time())){
+      return true;
+    }
+
+    // For events with sharded booking counters, the cached count does not show the seats given back.
+    return give_back_expired_holds(cn);
+  }
+
+  event::taken_seat event::take_seat(const db::connector& cn, const user_r& u){
+    taken_seat ts;
+
+    if (count_seat(cn, u, ts) || (give_back_expired_holds(cn) && count_seat(cn, u, ts))){
+      return ts;
+    }
+
+    throw event_is_not_bookable();
+  }
+
+  void event::give_back_seat(const taken_seat& ts){
+    if (ts.seat){
+      (*ts.seat)->unpublish();
+    }
+    
+    if (ts.counter){
+      (*ts.counter)->unbook();
+      return;
+    }
+
+    HX2A_ASSERT(_bookings_count);
+    _bookings_count = capacity_t(_bookings_count - 1);
+  }
+
+  bool event::count_seat(const db::connector& cn, const user_r& u, taken_seat& ts){
+    if (!_booking_shards){
+      if (!has_unlimited_capacity() && _bookings_count >= _capacity){
+	return false;
+      }
+
+      // Seats are mostly taken in order.
+      if (_seat_documents && !(ts.seat = claim_seat(cn, _bookings_count))){
+	return false;
+      }
+      
+      _bookings_count = capacity_t(_bookings_count + 1);
+      return true;
+    }
+
+    // Each user has a preferred counter, the others are tried when it is full.
+    uint64_t h = hasher().add_printable(u->get_id()).get();
+    size_t first = h % _booking_shards;
+
+    for (size_t i = 0; i != _booking_shards; ++i){
+      booking_counter_p bc = root_get<booking_counter>(cn, booking_counter::make_id(get_id(), (first + i) % _booking_shards));
+
+      if (bc && !(*bc)->is_full()){
+	// The counters are updated concurrently, seats are spread so that takers do not all probe the same ones.
+	if (_seat_documents && !(ts.seat = claim_seat(cn, h % _capacity))){
+	  return false;
+	}
+	
+	(*bc)->book();
+	ts.counter = bc;
+	return true;
+      }
+    }
+
+    return false;
+  }
+
+  seat_p event::claim_seat(const db::connector& cn, size_t start){
+    HX2A_ASSERT(has_finite_capacity());
+    size_t probes = ::std::min(size_t(_capacity), get_seat_probes_limit());
+
+    for (size_t i = 0; i != probes; ++i){
+      capacity_t n = capacity_t((start + i) % _capacity);
+      doc_id id = seat::make_id(get_id(), n);
+
+      if (!root_get<seat>(cn, id)){
+	// A concurrent taker of the same seat fails on insertion.
+	return make_derived<seat>(cn, id, *this, n);
+      }
+    }
+
+    HX2A_LOG(trace) << "No free seat found for event " << get_id() << " in " << probes << " probes.";
+    return {};
+  }
+
+  void event::resize_seats(const db::connector& cn, capacity_t capacity){
+    if (!_seat_documents){
+      return;
+    }
+
+    if (is_infinite(capacity)){
+      _seat_documents = false;
+      return;
+    }
+
+    for (size_t n = capacity; n < _capacity; ++n){
+      if (root_get<seat>(cn, seat::make_id(get_id(), capacity_t(n)))){
+	throw invalid_capacity();
+      }
+    }
+  }
+
+  size_t event::give_back_expired_holds(const db::connector& cn){
+    time_t now = time();
+    size_t n = 0;
+    // By batches of 100.
+    cursor c = cursor_on_key<seat_hold>(cn->get_index(seat_hold::index_by_event), {.key = {get_id()}, .limit = 100});
+
+    for_each_doc(c, [now, &n](const seat_hold_r& sh){
+      if (sh->is_expired(now)){
+	HX2A_LOG(trace) << "Giving back the seat of the expired hold " << sh->get_id() << ", the event is full.";
+	sh->give_back();
+	++n;
+      }
+    });
+
+    return n;
+  }
+
+  time_t seat_hold::hold(const db::connector& cn, const event_r& e, const user_r& holder){
+    if (!e->is_open_for_bookings()){
+      throw event_is_not_bookable();
+    }
+
+    // An expired hold not swept yet still has its seat.
+    if (seat_hold_p sh = get(cn, e->get_id(), holder)){
+      (*sh)->extend();
+      return (*sh)->get_expiry_timestamp();
+    }
+
+    event::taken_seat ts = e->take_seat(cn, holder);
+    seat_hold_r h = make_derived<seat_hold>(cn, make_id(e->get_id(), holder->get_id()), e, holder->get_id());
+
+    if (ts.counter){
+      h->_counter = *ts.counter;
+    }
+
+    if (ts.seat){
+      h->_seat = *ts.seat;
+    }
+
+    h->extend();
+    return h->get_expiry_timestamp();
+  }
+
+  void seat_hold::release(const db::connector& cn, const event_r& e, const user_r& holder){
+    if (seat_hold_p sh = get(cn, e->get_id(), holder)){
+      (*sh)->give_back();
+    }
+  }
+
+  event::taken_seat seat_hold::use_seat(){
+    event::taken_seat ts{_counter, _seat};
+    unpublish();
+    return ts;
+  }
+
+  void seat_hold::give_back(){
+    _event->give_back_seat({_counter, _seat});
+    unpublish();
+  }
+
+  void seat_hold::extend(){
+    _expiry_timestamp = time() + time_t(get_seat_hold_duration());
+    _expiry_minute = _expiry_timestamp / seconds_per_minute;
+  }
+
+  size_t seat_hold::sweep(const db::connector& cn){
+    // The last minute of which all the holds have expired.
+    time_t last = time() / seconds_per_minute - 1;
+    size_t n = 0;
+
+    for (time_t m = last - time_t(get_seat_holds_sweep_minutes()); m <= last; ++m){
+      // By batches of 100.
+      cursor c = cursor_on_key<seat_hold>(cn->get_index(index_by_expiry_minute), {.key = {m}, .limit = 100});
+
+      for_each_doc(c, [&n](const seat_hold_r& sh){
+	HX2A_LOG(trace) << "Giving back the seat of the expired hold " << sh->get_id() << ".";
+	sh->give_back();
+	++n;
+      });
+    }
+
+    return n;
+  }
+
+  void event::rebuild_guests_filter(const db::connector& cn){
+    // Their bookings do not update the event document.
+    if (_booking_shards){
+      throw guests_filter_unavailable();
+    }
+    
+    bloom_filter f;
+
+    // By batches of 100.
+    cursor ic = cursor_on_key<invite>(cn->get_index(invite::index_by_event), {.key = {get_id()}, .limit = 100});
+
+    for_each_doc(ic, [&f](const invite_r& i){
+      f.add(i->get_guest()->get_id());
+    });
+
+    cursor bc = cursor_on_key<booking>(cn->get_index(booking::index_by_event), {.key = {get_id()}, .limit = 100});
+
+    for_each_doc(bc, [&f](const booking_r& b){
+      f.add(b->get_guest()->get_id());
+    });
+
+    set_guests_filter(f);
+  }
+
+  bool event::has_access(const db::connector& cn, const user_r& u) const {
+    if (get_organizer() == u){
+      return true;
+    }
+
+    access_cache& ac = get_access_cache();
+    
+    if (ac.contains(get_id(), u->get_id())){
+      return true;
+    }
+
+    // Invites are looked up first, most users of private events are invited.
+    if (get_invite(cn, u) || get_booking(cn, u)){
+      ac.insert(get_id(), u->get_id());
+      return true;
+    }
+
+    return false;
+  }
+
+  booking_r booking::create(const db::connector& c, const event_r& e, const user_r& host, const user_r& guest, string display_name, string note){
+    if (e->lookup_booking(c, guest)){
+      throw booking_already_made();
+    }
+
+    booking_r b = get_derived_booking_ids_since() ?
+      // A concurrent creation for the same event and guest fails on insertion.
+      make_derived<booking>(c, make_id(e->get_id(), guest->get_id()), e, host, guest, display_name, note) :
+      make<booking>(c, e, host, guest, display_name, note);
+    b->_agenda_item = make<agenda_item>(c, guest, e, agenda_item::booking_item, b->get_id());
+    e->add_guest(guest);
+    return b;
+  }
+
+  invite_r invite::create(const db::connector& c, const event_r& e, const user_r& host, const user_r& guest){
+    if (e->lookup_invite(c, guest)){
+      throw invite_already_made();
+    }
+
+    if (e->lookup_booking(c, guest)){
+      throw booking_already_made();
+    }
+
+    return make_new(c, e, host, guest);
+  }
+
+  invite_p invite::create_if_new(const db::connector& c, const event_r& e, const user_r& host, const user_r& guest){
+    if (e->lookup_invite(c, guest) || e->lookup_booking(c, guest)){
+      return {};
+    }
+
+    return make_new(c, e, host, guest);
+  }
+
+  invite_r invite::make_new(const db::connector& c, const event_r& e, const user_r& host, const user_r& guest){
+    invite_r i = get_derived_invite_ids_since() ?
+      // A concurrent creation for the same event and guest fails on insertion.
+      make_derived<invite>(c, make_id(e->get_id(), guest->get_id()), e, host, guest) :
+      make<invite>(c, e, host, guest);
+    i->_agenda_item = make<agenda_item>(c, guest, e, agenda_item::invite_item, i->get_id());
+    e->add_guest(guest);
+    return i;
+  }
+
+  void agenda_item::update(const db::connector& cn, const event_r& e){
+    // By batches of 100.
+    cursor c = cursor_on_key<agenda_item>(cn->get_index(index_by_event), {.key = {e->get_id()}, .limit = 100});
+
+    for_each_doc(c, [](const agenda_item_r& ai){
+      ai->update();
+    });
+  }
+
+  bool removal::are_kept_since(time_t t){
+    return t >= time() - time_t(get_removal_retention());
+  }
+
+  size_t removal::sweep(const db::connector& cn){
+    // The last day of which all the removals are older than the retention period.
+    time_t last = (time() - time_t(get_removal_retention())) / seconds_per_day - 1;
+    size_t n = 0;
+
+    for (time_t d = last - time_t(get_removal_sweep_days()); d <= last; ++d){
+      if (d <= 0){
+	continue;
+      }
+      
+      // By batches of 100.
+      cursor c = cursor_on_key<removal>(cn->get_index(index_by_day), {.key = {d}, .limit = 100});
+
+      for_each_doc(c, [&n](const removal_r& r){
+	r->unpublish();
+	++n;
+      });
+    }
+
+    return n;
   }
 
   event_p event::get_from_conversation_id(const db::connector& cn, const doc_id& conversation_id){
@@ -136,34 +873,83 @@ namespace events {
     m.send();
   }
   
+  void open_invite::add_contact(const db::connector& cn, const contact_r& cont){
+    const string& email = cont->get_email();
+
+    // Inline contacts removed by accepts and declines make room inline for contacts which can already be stored.
+    if (find_contact(email) != _contacts.cend() || get_stored_contact(cn, email)){
+      // We silently return without any fuss.
+      return;
+    }
+
+    if (_contacts.size() < get_contacts_in_open_invite_limit()){
+      _contacts.push_back(cont);
+      return;
+    }
+
+    if (_stored_contacts_count >= get_stored_contacts_in_open_invite_limit()){
+      throw contacts_in_open_invite_limit_reached();
+    }
+
+    // A concurrent addition of the same email address fails on insertion.
+    make_derived<open_invite_contact>(cn, open_invite_contact::make_id(get_id(), email), *this, cont);
+    _stored_contacts_count = _stored_contacts_count + 1;
+  }
+
+  open_invite_contact_p open_invite::get_stored_contact(const db::connector& cn, const string& email) const {
+    // Most open invites do not have stored contacts, saving the get.
+    if (!_stored_contacts_count){
+      return {};
+    }
+
+    return root_get<open_invite_contact>(cn, open_invite_contact::make_id(get_id(), email));
+  }
+
+  void open_invite::erase_contact(contacts_type::const_iterator i, const open_invite_contact_p& sc){
+    if (sc){
+      (*sc)->unpublish();
+      HX2A_ASSERT(_stored_contacts_count);
+      _stored_contacts_count = _stored_contacts_count - 1;
+    }
+    else{
+      _contacts.erase(i);
+    }
+  }
+  
   booking_r open_invite::accept(const db::connector& c, const user_r& guest, string display_name, string note){
     HX2A_ASSERT(_event);
     HX2A_ASSERT(_host);
 
-    auto i = find_contact(guest->get_email());
+    const string& email = guest->get_email();
+    auto i = find_contact(email);
+    open_invite_contact_p sc;
 
-    if (i == _contacts.cend()){
+    if (i == _contacts.cend() && !(sc = get_stored_contact(c, email))){
       throw invite_does_not_exist();
     }
     
-    if (_event->is_bookable()){
-      booking_r b = make<booking>(c, *_event, *_host, guest, display_name, note);
-      // Removing the email address.
-      _contacts.erase(i);
+    if (_event->is_bookable_by(c, guest)){
+      booking_r b = booking::create(c, *_event, *_host, guest, display_name, note);
+      // Removing the email address. The open invite leaves the guest's list.
+      erase_contact(i, sc);
+      removal::log(c, guest, get_id(), removal::open_invite_removal);
       return b;
     }
 
     throw event_is_not_bookable();
   }
 
-  void open_invite::decline(const user_r& guest){
-    auto i = find_contact(guest->get_email());
+  void open_invite::decline(const db::connector& cn, const user_r& guest){
+    const string& email = guest->get_email();
+    auto i = find_contact(email);
+    open_invite_contact_p sc;
 
-    if (i == _contacts.cend()){
+    if (i == _contacts.cend() && !(sc = get_stored_contact(cn, email))){
       throw invite_does_not_exist();
     }
     
-    _contacts.erase(i);
+    erase_contact(i, sc);
+    removal::log(cn, guest, get_id(), removal::open_invite_removal);
   }
 
   booking_r invite::accept(const db::connector& c, string display_name, string note){
@@ -171,8 +957,11 @@ namespace events {
     HX2A_ASSERT(_host);
     HX2A_ASSERT(_guest);
 
-    if (_event->is_bookable()){
-      booking_r b = make<booking>(c, *_event, *_host, *_guest, display_name, note);
+    if (_event->is_bookable_by(c, *_guest)){
+      booking_r b = booking::create(c, *_event, *_host, *_guest, display_name, note);
+      removal::log(c, *_guest, get_id(), removal::invite_removal);
+      // The booking has its own.
+      remove_agenda_item();
       // Committing seppuku.
       unpublish();
       return b;
@@ -181,7 +970,7 @@ namespace events {
     throw event_is_not_bookable();
   }
 
-  void invite::notify_devices() const {
+  void invite::notify_devices(push_batcher& b, const doc_id& source) const {
     // Retrieving all the client states for the invited user. Sending an Expo message to all the current
     // tokens.
     db::connector cn{client_state_dbname};
@@ -189,10 +978,16 @@ namespace events {
     cursor c = cursor_on_key<client_state>(cn->get_index(client_state::index_by_user), {.key = {_guest->get_id()}, .limit = 100});
     doc_id did = _guest->get_id();
     
-    for_each_doc(c, [this, &did](const client_state_r& cs){
+    for_each_doc(c, [this, &cn, &did, &b, &source](const client_state_r& cs){
       const string& app_token = cs->get_app_token();
       HX2A_LOG(trace) << "Found client state " << cs->get_id() << " for user " << did << " containing token \"" << app_token << "\".";
 
+      // The device can have changed hands, and the client state not been removed yet.
+      if (!cs->is_current(cn)){
+	HX2A_LOG(trace) << "Client state " << cs->get_id() << " is superseded for its token, not notifying.";
+	return;
+      }
+
       if (app_token.size()){
 	HX2A_ASSERT(_event);
 	event_r e = *_event;
@@ -210,10 +1005,171 @@ namespace events {
 	  }
 	}
 	
-	expo::notifier n(app_token, format("You have been invited by ", inviter), {} /* no body */);
-	n();
+	b.add(did, app_token, push_batcher::invite_push, get_id(), format("You have been invited by ", inviter), source);
       }
     });
   }
 
+  void notification::post(const db::connector& cn, const invite_r& i){
+    if (!get_notifications_outbox()){
+      i->notify();
+      return;
+    }
+
+    make<notification>(cn, invite_email, i);
+    make<notification>(cn, invite_devices, i);
+  }
+
+  bool notification::send(push_batcher& b){
+    HX2A_ASSERT(_invite);
+    
+    try{
+      switch (_kind){
+      case invite_email:
+	_invite->send_email();
+	break;
+      case invite_devices:
+	_invite->notify_devices(b, get_id());
+	// Completed once the batcher is flushed.
+	return true;
+      }
+    }
+    catch (const ::std::exception& e){
+      retry(e.what());
+      return false;
+    }
+
+    unpublish();
+    return true;
+  }
+
+  bool notification::complete(const push_batcher& b){
+    HX2A_ASSERT(_kind == invite_devices);
+    
+    if (b.has_failed(get_id())){
+      retry("push failed");
+      return false;
+    }
+
+    unpublish();
+    return true;
+  }
+
+  void notification::retry(const char* reason){
+    _attempts = _attempts + 1;
+    _lease_owner = doc_id{};
+    
+    if (_attempts >= get_notification_max_attempts()){
+      HX2A_LOG(error) << "Notification " << get_id() << " failed after " << _attempts << " attempts: " << reason;
+      _state = failed;
+    }
+    else{
+      HX2A_LOG(trace) << "Notification " << get_id() << " failed, attempt " << _attempts << ": " << reason;
+      _state = pending;
+      schedule(time() + (time_t(get_notification_retry_delay()) << (_attempts - 1)));
+    }
+  }
+
+  bool notification::claim(const doc_id& owner, time_t now){
+    if (_state != pending || _next_attempt_timestamp > now){
+      return false;
+    }
+
+    _state = claimed;
+    _lease_owner = owner;
+    schedule(now + time_t(get_notification_lease()));
+    return true;
+  }
+
+  size_t notification::drain(const db::connector& cn){
+    // One drain at a time per worker. Statics are thread-safe.
+    static ::std::mutex m;
+    ::std::unique_lock<::std::mutex> l(m, ::std::try_to_lock);
+
+    if (!l.owns_lock()){
+      HX2A_LOG(trace) << "Notifications drain already running.";
+      return 0;
+    }
+    
+    time_t now = time();
+    const doc_id& w = get_worker_id();
+    size_t limit = get_notifications_drain_limit();
+    // To send in this drain.
+    ::std::vector<notification_r> ns;
+    // The notifications claimed by the previous drains of the worker. By batches of 100.
+    cursor sc = cursor_on_key<notification>(cn->get_index(index_by_state_and_lease_owner), {.key = {claimed, w}, .limit = 100});
+
+    for_each_doc(sc, [&](const notification_r& n){
+      // The lease can have expired, and the notification sent by another worker since.
+      if (n->is_claimed_by(w, now)){
+	ns.push_back(n);
+      }
+    });
+
+    // Reading the buckets from the mark: claiming the pending notifications due for the next drain, and sending the
+    // claimed ones with expired leases now.
+    time_t last_bucket = now / seconds_per_bucket;
+    time_t lookback = time_t(get_notifications_drain_lookback());
+    doc_id mid = notifications_drain_mark::make_id();
+    notifications_drain_mark_p dm = root_get<notifications_drain_mark>(cn, mid);
+    notifications_drain_mark_r mark = dm ? *dm : make_derived<notifications_drain_mark>(cn, mid, last_bucket - lookback);
+    time_t bk = mark->get_bucket();
+    time_t end = ::std::min(last_bucket, bk + lookback);
+    size_t claims = 0;
+
+    for (; bk <= end && claims + ns.size() < limit; ++bk){
+      for (state_t st: {pending, claimed}){
+	// By batches of 100.
+	cursor cc = cursor_on_key<notification>(cn->get_index(index_by_state_and_bucket), {.key = {st, bk}, .limit = 100});
+
+	for_each_doc(cc, [&](const notification_r& n){
+	  if (claims + ns.size() >= limit){
+	    return;
+	  }
+
+	  if (n->is_lease_expired(now)){
+	    ns.push_back(n);
+	  }
+	  else if (n->claim(w, now)){
+	    ++claims;
+	  }
+	});
+      }
+    }
+
+    // The bucket where the limit was reached can have more, and the current one is still filling up. One more bucket
+    // for the clocks of the other workers.
+    mark->advance(::std::min(bk, last_bucket) - 1);
+    size_t sent = 0;
+    // Pushes for all the invites drained are sent together.
+    push_batcher b;
+    // The devices notifications handed to the batcher, completed once it is flushed.
+    ::std::vector<notification_r> pushes;
+
+    for (const notification_r& n: ns){
+      if (!n->send(b)){
+	continue;
+      }
+
+      if (n->get_kind() == invite_devices){
+	pushes.push_back(n);
+      }
+      else{
+	++sent;
+      }
+    }
+
+    b.flush();
+
+    for (const notification_r& n: pushes){
+      if (n->complete(b)){
+	++sent;
+      }
+    }
+    
+    const push_batcher::receipt& r = b.get_total();
+    HX2A_LOG(trace) << "Drained " << ns.size() << " notifications, " << sent << " sent, " << claims << " claimed. Pushes: " << r.sent << " sent, " << r.failed << " failed, " << b.get_coalesced_count() << " coalesced.";
+    return sent;
+  }
+
 } // End namespace events.
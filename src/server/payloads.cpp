@@ -11,7 +11,8 @@ namespace events {
   using namespace hx2a;
 
   open_invite_data_payload:: open_invite_data_payload(const open_invite_r& oi):
-    contacts(*this)
+    contacts(*this),
+    count(*this, oi->get_contacts_count())
   {
     auto i = oi->contacts_cbegin();
     auto e = oi->contacts_cend();
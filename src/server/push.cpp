@@ -0,0 +1,77 @@
+//
+// Copyright Metaspex - 2024
+// mailto:admin@metaspex.com
+//
+
+#include "hx2a/format.hpp"
+
+#include "hx2a/http/expo.hpp"
+
+#include "events/push.hpp"
+
+namespace events {
+
+  using namespace hx2a;
+
+  void push_batcher::flush(){
+    if (_messages.empty()){
+      return;
+    }
+
+    auto i = _messages.cbegin();
+    auto e = _messages.cend();
+
+    while (i != e){
+      auto n = e - i > ptrdiff_t(batch_size) ? i + batch_size : e;
+      receipt r = send(i, n);
+      HX2A_LOG(trace) << "Push batch of " << n - i << " messages: " << r.sent << " sent, " << r.failed << " failed.";
+      _total.sent += r.sent;
+      _total.failed += r.failed;
+      i = n;
+    }
+
+    for (const message& m: _messages){
+      _coalesced += m.count - 1;
+    }
+    
+    _messages.clear();
+    _indexes.clear();
+  }
+
+  string push_batcher::summarize(const message& m){
+    if (m.count == 1){
+      return m.title;
+    }
+
+    switch (m.kind){
+    case invite_push:
+      return format("You have been invited to ", m.count, " events");
+    }
+
+    return m.title;
+  }
+
+  // The Expo notifier sends one message per request, there is no batch request here. This is the single place to switch
+  // to Expo's batch endpoint.
+  push_batcher::receipt push_batcher::send(::std::vector<message>::const_iterator i, ::std::vector<message>::const_iterator e){
+    receipt r;
+
+    for (; i != e; ++i){
+      const message& m = *i;
+      
+      try{
+	expo::notifier n(m.token, summarize(m), {} /* no body */);
+	n();
+	++r.sent;
+      }
+      catch (const ::std::exception& e){
+	HX2A_LOG(trace) << "Push to token \"" << m.token << "\" failed: " << e.what();
+	++r.failed;
+	_failed_sources.insert(m.sources.cbegin(), m.sources.cend());
+      }
+    }
+
+    return r;
+  }
+
+} // End namespace events.
@@ -3,6 +3,10 @@
 // mailto:admin@metaspex.com
 //
 
+#include <map>
+#include <set>
+#include <vector>
+
 #include "hx2a/server.hpp"
 #include "hx2a/service.hpp"
 #include "hx2a/session_info.hpp"
@@ -24,7 +28,9 @@
 
 #include "messenger/exception.hpp"
 
+#include "events/admission.hpp"
 #include "events/client_state.hpp"
+#include "events/etag.hpp"
 #include "events/exception.hpp"
 #include "events/ontology.hpp"
 #include "events/payloads.hpp"
@@ -32,6 +38,8 @@
 
 namespace events {
 
+  // Gotten from the database on each call, it holds the Messenger's state, which the Messenger can modify. Not shared
+  // between services.
   inline client_state_p get_client_state(const session_info& si){
     doc_id session_id = si.get_session_id();
     
@@ -42,7 +50,9 @@ namespace events {
     }
 
     db::connector cn{client_state_dbname};
-    return root_get<client_state>(cn, session_id).or_throw<messenger::client_state_does_not_exist>();    
+    client_state_r cs = root_get<client_state>(cn, session_id).or_throw<messenger::client_state_does_not_exist>();
+    cs->touch();
+    return cs;
   }
 
   inline client_state_r set_client_state(session_info& si, const user_r& u, const string& token){
@@ -50,9 +60,8 @@ namespace events {
     
     if (session_id.is_null()){
       db::connector cn{client_state_dbname};
-      // Cleaning up zombie client states (e.g., if a user has logged in without properly logged out).
-      client_state::clean_up(cn, u, token);
-      client_state_r cs = make<client_state>(cn, u, token);
+      // Replacing the client state of the previous session with the same token, see client_state.hpp.
+      client_state_r cs = client_state::create(cn, u, token);
       doc_id session_id = cs->get_id();
       HX2A_LOG(trace) << "Created a Events client state document, its id is " << session_id;
       si.set_session_id(session_id);
@@ -150,6 +159,15 @@ namespace events {
       }
     };
     
+    struct organizer_or_host_checker
+    {
+      void operator()(const open_invite_r& i, const user_r& u) const {
+	if (i->get_host() != u && i->get_event()->get_organizer() != u && !u->is_root_user()){
+	  throw unauthorized();
+	}
+      }
+    };
+    
     struct organizer_or_venue_owner_checker
     {
       void operator()(const event_r& e, const user_r& u) const {
@@ -193,8 +211,7 @@ namespace events {
 	    e->is_private() &&
 	    e->get_organizer() != u &&
 	    !u->is_root_user() &&
-	    !e->get_invite(cn, u) && // No invite.
-	    !e->get_booking(cn, u) // No booking.
+	    !e->has_access(cn, u) // No invite nor booking.
 	    ){
 	  throw unauthorized();
 	}
@@ -257,7 +274,8 @@ namespace events {
       
       // Never know.
       if (cs){
-	(*cs)->unpublish();
+	db::connector cn{client_state_dbname};
+	(*cs)->remove(cn);
       }
     });
 
@@ -331,12 +349,20 @@ namespace events {
   // Only the owner and the root user can get it if it is private.
   // Allowing somebody to get venue details by search if they have an invite or a booking for that venue is extravagantly expensive. So we have
   // specific services for that, giving the invite or the booking.
+  // Conditional: if the query supplies the entity tag of the current venue data, the reply is empty (JSON object {}).
   auto _venue_get = service<srv_tag<"venue_get">>
-    ([](const user_p& u, const rfr<venue_id_payload>& query){
+    ([](const user_p& u, const rfr<venue_get_payload>& query) -> venue_data_with_etag_payload_p {
       db::connector cn{dbname};
       venue_r v = root_get<venue>(cn, query->venue_id).or_throw<venue_does_not_exist>();
       privacy_checker()(v, u);
-      return make<venue_data_payload>(v);
+      etag t(v);
+
+      if (t == query->etag.get()){
+	HX2A_LOG(trace) << "Venue " << v->get_id() << " not modified.";
+	return {};
+      }
+      
+      return make<venue_data_with_etag_payload>(v, t.str());
     });
 
   auto _venue_get_from_invite = service<srv_tag<"venue_get_from_invite">>
@@ -401,12 +427,27 @@ namespace events {
       v->unpublish();
     });
 
-  using venues_vector = std::vector<venue_p>;
+  using venues_vector = search_scratch<venue>::vector_type;
   using venues_vector_iterator = venues_vector::iterator;
 
-  static inline void fill_venue_search_reply(const venue_search_reply_r& sr, venues_vector_iterator& i, venues_vector_iterator e){
+  // The beginning of the results is supplied to number them for the chunk.
+  static inline void fill_venue_search_reply(const venue_search_reply_r& sr, venues_vector_iterator b, venues_vector_iterator& i, venues_vector_iterator e, field_mask_t m, const search_chunk& c){
     while (i != e){
-      sr->push_venue_data_back(make<venue_search_data_payload>(**i));
+      uint64_t n = uint64_t(i - b);
+
+      if (c.before(n)){
+	++i;
+	continue;
+      }
+
+      if (c.after(n)){
+	// The rest is for the next chunks.
+	sr->set_next(c.end);
+	i = e;
+	return;
+      }
+      
+      sr->push_venue_data_back(make<venue_search_data_payload>(**i, m));
       ++i;
     }
   }
@@ -417,6 +458,8 @@ namespace events {
   // An empty array of categories means that the client wishes to grab them all.
   // The root user will see all venues, including the private ones.
   // Regular users can see all public venues and all their own private ones.
+  // The optional fields mask of the query restricts the fields calculated for each venue.
+  // The query can ask for a chunk of the results only, see search chunks in payloads.hpp.
   // A possible extension is to have a kdtree of invites/bookings so that the invited/booked users can do a  search and see
   // the private venues with events they have invites/bookings for.
   auto _venue_search = service<srv_tag<"venue_search">>
@@ -427,13 +470,17 @@ namespace events {
       // No connector yet, we look in the venues kdtree.
       // We add one so that if we find more than the requested amount, we return nothing so that the user has to zoom in.
       size_t vsl = get_venues_search_limit() + 1;
-      venues_vector v(vsl);
+      // Reusing the thread's vector.
+      search_scratch<venue> scratch(vsl);
+      venues_vector& v = scratch.get();
       venues_vector_iterator i = v.begin();
       // Putting the intervals aside in case we reuse them for erasure.
       interval<latitude_t> li = query->get_latitude_interval();
       interval<longitude_t> Li = query->get_longitude_interval();
       // An empty array of categories means that the client wishes to grab them all.
       bool all_categories = query->categories.empty();
+      // The results turned into payloads.
+      search_chunk chunk(query);
 
       // The root user sees everything.
       if (u && (*u)->is_root_user()){
@@ -462,7 +509,7 @@ namespace events {
 	  HX2A_LOG(trace) << "Found " << e - i << " venues.";
 	  // Now we can connect to the database and get the documents (if any).
 	  venue_search_reply_r sr = make<venue_search_reply>();
-	  fill_venue_search_reply(sr, i, e);
+	  fill_venue_search_reply(sr, v.begin(), i, e, query->fields, chunk);
 	  return sr;
 	}
 
@@ -488,7 +535,7 @@ namespace events {
 	  }
 	  
 	  HX2A_LOG(trace) << "Found " << e - i << " venues for category " << cat << '.';
-	  fill_venue_search_reply(sr, i, e);
+	  fill_venue_search_reply(sr, v.begin(), i, e, query->fields, chunk);
 	  HX2A_ASSERT(i == e);
 	}
 	
@@ -522,7 +569,7 @@ namespace events {
 	HX2A_LOG(trace) << "Found " << e - i << " public venues.";
 	// Now we can connect to the database and get the documents (if any).
 	venue_search_reply_r sr = make<venue_search_reply>();
-	fill_venue_search_reply(sr, i, e);
+	fill_venue_search_reply(sr, v.begin(), i, e, query->fields, chunk);
 
 	if (u){
 	  // Let's add the user's private venues.
@@ -544,7 +591,7 @@ namespace events {
 	  }
 	  
 	  HX2A_LOG(trace) << "Found " << e - i << " private venues.";
-	  fill_venue_search_reply(sr, i, e);
+	  fill_venue_search_reply(sr, v.begin(), i, e, query->fields, chunk);
 	  HX2A_ASSERT(i == e);
 	}
 	
@@ -574,7 +621,7 @@ namespace events {
 	}
 
 	HX2A_LOG(trace) << "Found " << e - i << " public venues for category " << cat << '.';
-	fill_venue_search_reply(sr, i, e);
+	fill_venue_search_reply(sr, v.begin(), i, e, query->fields, chunk);
 	HX2A_ASSERT(i == e);
 
 	if (u){
@@ -597,7 +644,7 @@ namespace events {
 	  }
 	  
 	  HX2A_LOG(trace) << "Found " << e - i << " private venues for category " << cat << '.';
-	  fill_venue_search_reply(sr, i, e);
+	  fill_venue_search_reply(sr, v.begin(), i, e, query->fields, chunk);
 	  HX2A_ASSERT(i == e);
 	}
       }
@@ -629,6 +676,10 @@ namespace events {
       // The event cache will be updated by the cache reading the database.
       event_r e = make<event>(cn, prologue.user, query->name, query->is_private, query->category, query->category_description, v, query->capacity, query->start, query->duration, query->bookings_notice_time, query->organizer_display_name);
 
+      if (size_t shards = get_booking_shards()){
+	e->shard_bookings(cn, shards);
+      }
+
       for (const auto& i: query->images){
 	e->push_image_back(i.get());
       }
@@ -638,12 +689,20 @@ namespace events {
 
   // Anybody can get a public event.
   // Only the organizer, the root user, an invited user or a booked user can get it if it is private.
+  // Conditional: if the query supplies the entity tag of the current event data, the reply is empty (JSON object {}).
   auto _event_get = service<srv_tag<"event_get">>
-    ([](const user_p& u, const rfr<event_id_payload>& query){
+    ([](const user_p& u, const rfr<event_get_payload>& query) -> event_data_with_etag_payload_p {
       db::connector cn{dbname};
       event_r e = root_get<event>(cn, query->event_id).or_throw<event_does_not_exist>();
       privacy_checker()(cn, e, u);
-      return make<event_data_payload>(e);
+      etag t(e);
+
+      if (t == query->etag.get()){
+	HX2A_LOG(trace) << "Event " << e->get_id() << " not modified.";
+	return {};
+      }
+      
+      return make<event_data_with_etag_payload>(e, t.str());
     });
 
   // Only the organizer and the root user can ask for an event to be confirmed by the venue owner.
@@ -722,8 +781,15 @@ namespace events {
       db::connector cn{dbname};
       event_r e = root_get<event>(cn, query->event_id).or_throw<event_does_not_exist>();
       organizer_checker()(e, prologue.user);
+      string name = e->get_name();
+      time_t start = e->get_start();
       // The update payload sets capacity to 0 if unspecified.
-      e->update(query->name, query->category, query->category_description, query->capacity, query->start, query->duration, query->bookings_notice_time);
+      e->update(cn, query->name, query->category, query->category_description, query->capacity, query->start, query->duration, query->bookings_notice_time);
+
+      // The agendas copy the name and the start. A popular event has many items, they are rewritten only if needed.
+      if (e->get_name() != name || e->get_start() != start){
+	agenda_item::update(cn, e);
+      }
     });
 
   // Only a participant can report. A participant can report multiple times.
@@ -735,6 +801,16 @@ namespace events {
       e->report();
     });
 
+  // Recalculates the guests filter of an event from the indexes. For events created before filters existed, to clean
+  // up the false positives left by cancellations, or to restore the guests lost by concurrent creations. Not for events
+  // with sharded booking counters.
+  auto _event_rebuild_guests_filter = service<srv_tag<"event_rebuild_guests_filter">, root_checker_prologue>
+    ([](const rfr<event_id_payload>& query){
+      db::connector cn{dbname};
+      event_r e = root_get<event>(cn, query->event_id).or_throw<event_does_not_exist>();
+      e->rebuild_guests_filter(cn);
+    });
+
   // Only the organizer or the root user can update an event.
   auto _event_update_images = service<srv_tag<"event_update_images">>
     ([](const login_checker_prologue& prologue, const rfr<event_update_images_payload>& query){
@@ -751,19 +827,65 @@ namespace events {
       event_r e = root_get<event>(cn, query->event_id).or_throw<event_does_not_exist>();
       organizer_checker()(e, prologue.user);
       venue_r v = root_get<venue>(cn, query->venue_id).or_throw<venue_does_not_exist>();
-      e->set_venue(v);
+      e->set_venue(cn, v);
       // An email could be sent to the venue owner and guests and invited people could be notified.
     });
 
-  using events_vector = std::vector<event_p>;
+  using events_vector = search_scratch<event>::vector_type;
   using events_vector_iterator = events_vector::iterator;
 
-  static inline void fill_event_search_reply(const event_search_reply_r& sr, events_vector_iterator& i, events_vector_iterator e){
+  // Links of the events found by a search, see event_links in payloads.hpp. Events at the same venue share the venue's
+  // links. Kept for the duration of the request only, nothing is shared across requests.
+  class search_links
+  {
+  public:
+
+    event_links get(const event_r& e){
+      venue_r v = e->get_venue();
+      auto i = _venues.find(v->get_id());
+
+      if (i == _venues.end()){
+	i = _venues.emplace(v->get_id(), venue_links(v)).first;
+      }
+
+      return {i->second};
+    }
+
+  private:
+
+    ::std::map<doc_id, venue_links> _venues;
+  };
+
+  // The beginning of the results is supplied to number them for the chunk.
+  static inline void fill_event_search_reply(const event_search_reply_r& sr, events_vector_iterator b, events_vector_iterator& i, events_vector_iterator e, field_mask_t m, const search_chunk& c){
+    bool links = requested_links(m, event_links_fields);
+    search_links sl;
+    
     while (i != e){
+      uint64_t n = uint64_t(i - b);
+
+      if (c.before(n)){
+	++i;
+	continue;
+      }
+
+      if (c.after(n)){
+	// The rest is for the next chunks.
+	sr->set_next(c.end);
+	i = e;
+	return;
+      }
+      
       event_r ce = **i;
 
       if (ce->is_bookable()){
-	sr->push_event_data_back(make<event_search_data_payload>(ce));
+	if (links){
+	  event_links l = sl.get(ce);
+	  sr->push_event_data_back(make<event_search_data_payload>(ce, m, &l));
+	}
+	else{
+	  sr->push_event_data_back(make<event_search_data_payload>(ce, m));
+	}
       }
       
       ++i;
@@ -773,6 +895,8 @@ namespace events {
   // Finding all events in an area and a period.
   // If the function returns an empty reply (JSON object {}) it means that the user must zoom in. There are too many documents.
   // If the function finds nothing, the JSON array will be empty. This allows to distinguish the two cases.
+  // The optional fields mask of the query restricts the fields calculated for each event.
+  // The query can ask for a chunk of the results only, see search chunks in payloads.hpp.
   // A possible extension is to have a kdtree of invites/bookings so that the invited/booked users can do a  search and see
   // the private events they have invites/bookings for.
   auto _event_search = service<srv_tag<"event_search">>
@@ -784,7 +908,9 @@ namespace events {
       // No connector yet, we look in the events kdtree.
       // We add one so that if we find more than the requested amount, we return nothing so that the user has to zoom in.
       size_t vsl = get_events_search_limit() + 1;
-      events_vector v(vsl);
+      // Reusing the thread's vector.
+      search_scratch<event> scratch(vsl);
+      events_vector& v = scratch.get();
       auto i = v.begin();
       area_r ar = query->the_area.or_throw<position_missing>();
       
@@ -800,6 +926,8 @@ namespace events {
 
       // An empty array of categories means that the client wishes to grab them all.
       bool all_categories = query->categories.empty();
+      // The results turned into payloads.
+      search_chunk chunk(query);
       
       // The root user sees everything.
       if (u && (*u)->is_root_user()){
@@ -833,7 +961,7 @@ namespace events {
 	  // Now we can connect to the database and get the documents (if any).
 	  event_search_reply_r sr = make<event_search_reply>();
 	  // It'll filter out the events that are not bookable.
-	  fill_event_search_reply(sr, i, e);
+	  fill_event_search_reply(sr, v.begin(), i, e, query->fields, chunk);
 	  return sr;
 	}
 
@@ -862,7 +990,7 @@ namespace events {
 	  
 	  HX2A_LOG(trace) << "Found " << e - i << " events for category " << cat << '.';
 	  // It'll filter out the events that are not bookable.
-	  fill_event_search_reply(sr, i, e);
+	  fill_event_search_reply(sr, v.begin(), i, e, query->fields, chunk);
 	  HX2A_ASSERT(i == e);
 	}
 	
@@ -898,7 +1026,7 @@ namespace events {
 	HX2A_LOG(trace) << "Found " << e - i << " public event(s).";
 	event_search_reply_r sr = make<event_search_reply>();
 	// It'll filter out the events that are not bookable.
-	fill_event_search_reply(sr, i, e);
+	fill_event_search_reply(sr, v.begin(), i, e, query->fields, chunk);
 
 	if (u){
 	  // Let's add the user's private events.
@@ -923,7 +1051,7 @@ namespace events {
 	  
 	  HX2A_LOG(trace) << "Found " << e - i << " private events.";
 	  // It'll filter out the events that are not bookable.
-	  fill_event_search_reply(sr, i, e);
+	  fill_event_search_reply(sr, v.begin(), i, e, query->fields, chunk);
 	  HX2A_ASSERT(i == e);
 	}
 	
@@ -956,7 +1084,7 @@ namespace events {
       
 	HX2A_LOG(trace) << "Found " << e - i << " public events for category " << cat << '.';
 	// It'll filter out the events that are not bookable.
-	fill_event_search_reply(sr, i, e);
+	fill_event_search_reply(sr, v.begin(), i, e, query->fields, chunk);
 	HX2A_ASSERT(i == e);
 
 	if (u){
@@ -982,7 +1110,7 @@ namespace events {
 	  
 	  HX2A_LOG(trace) << "Found " << e - i << " private events for category " << cat << '.';
 	  // It'll filter out the events that are not bookable.
-	  fill_event_search_reply(sr, i, e);
+	  fill_event_search_reply(sr, v.begin(), i, e, query->fields, chunk);
 	  HX2A_ASSERT(i == e);
 	}
       }
@@ -1000,7 +1128,7 @@ namespace events {
 	  !e->is_bookable() ||
 	  (
 	   (e->get_organizer() != prologue.user) && // The organizer is allowed to send invites.
-	   (e->is_private() || (!e->get_invite(cn, prologue.user) && !e->get_booking(cn, prologue.user))) // People with an invite or a booking can send invite for a public event.
+	   (e->is_private() || !e->has_access(cn, prologue.user)) // People with an invite or a booking can send invite for a public event.
 	   )
 	  ){
 	throw unauthorized();
@@ -1037,7 +1165,52 @@ namespace events {
 	throw unauthorized();
       }
       
-      root_get<open_invite>(cn, query->invite_id).or_throw<invite_does_not_exist>()->add_contact(make<contact>(query->first_name, query->last_name, email));
+      root_get<open_invite>(cn, query->invite_id).or_throw<invite_does_not_exist>()->add_contact(cn, make<contact>(query->first_name, query->last_name, email));
+    });
+
+  // Bulk import of contacts, for the host of the open invite, the organizer of the event or the root user.
+  // Nothing is added if a contact is invalid. Registered users are not added, their document identifiers are returned
+  // so that regular invites can be sent to them instead.
+  auto _open_invite_add_contacts = service<srv_tag<"open_invite_add_contacts">>
+    ([](const login_checker_prologue& prologue, const rfr<open_invite_add_contacts_payload>& query){
+      db::connector cn{dbname};
+      open_invite_r i = root_get<open_invite>(cn, query->invite_id).or_throw<invite_does_not_exist>();
+      organizer_or_host_checker()(i, prologue.user);
+
+      if (query->contacts.size() > get_contacts_in_bulk_limit()){
+	throw too_many_contacts();
+      }
+
+      // Validating everything first. Duplicate email addresses are checked in the directory and added once, the first
+      // contact supplied for an address is kept.
+      ::std::map<string, contact_r> emails;
+
+      for (const auto& c: query->contacts){
+	HX2A_ASSERT(c);
+	validate_email(c->get_email());
+	emails.try_emplace(c->get_email(), *c);
+      }
+
+      // The directory does not offer a batched lookup, one get per distinct address.
+      db::connector dc(db::directory_database);
+      ::std::set<string> registered;
+      guest_ids_payload_r r = make<guest_ids_payload>();
+
+      for (const auto& [e, c]: emails){
+	if (user_p u = user::get_from_email(dc, e)){
+	  registered.insert(e);
+	  r->guest_ids.push_back((*u)->get_id());
+	}
+      }
+
+      // The open invite is saved once at the end of the service.
+      for (const auto& [e, c]: emails){
+	if (!registered.contains(e)){
+	  i->add_contact(cn, c->copy());
+	}
+      }
+
+      return r;
     });
 
   // Only the organizer of the event or a person with a booking or an invite can create an invite.
@@ -1051,7 +1224,7 @@ namespace events {
 	  !e->is_bookable() ||
 	  (
 	   (e->get_organizer() != prologue.user) && // The organizer is allowed to send invites.
-	   (e->is_private() || (!e->get_invite(cn, prologue.user) && !e->get_booking(cn, prologue.user))) // People with an invite or a booking can send invite for a public event.
+	   (e->is_private() || !e->has_access(cn, prologue.user)) // People with an invite or a booking can send invite for a public event.
 	   )
 	  ){
 	throw unauthorized();
@@ -1060,20 +1233,63 @@ namespace events {
       db::connector dc(db::directory_database);
       user_r g = root_get<user>(dc, query->guest_id).or_throw<user_does_not_exist>();
 
-      // Checking that no invite for the user exists yet.
-      if (e->get_invite(cn, g)){
-	throw invite_already_made();
+      // Creating the invite checks that no invite nor booking for the user exists yet.
+      // The user calling the service is the host.
+      invite_r i = invite::create(cn, e, prologue.user, g);
+      notification::post(cn, i);
+      return make<invite_id_payload>(i);
+    });
+
+  // Same as above for a list of guests. Guests who already have an invite or a booking are skipped.
+  // Nothing is created if a guest does not exist.
+  auto _invites_create = service<srv_tag<"invites_create">>
+    ([](const login_checker_prologue& prologue, const rfr<invites_create_payload>& query){
+      db::connector cn{dbname};
+      event_r e = root_get<event>(cn, query->event_id).or_throw<event_does_not_exist>();
+
+      if (
+	  !e->is_bookable() ||
+	  (
+	   (e->get_organizer() != prologue.user) && // The organizer is allowed to send invites.
+	   (e->is_private() || !e->has_access(cn, prologue.user)) // People with an invite or a booking can send invite for a public event.
+	   )
+	  ){
+	throw unauthorized();
       }
-      
-      // Checking that no booking for the user exists yet.
-      if (e->get_booking(cn, g)){
-	throw booking_already_made();
+
+      if (query->guest_ids.size() > get_invites_in_bulk_limit()){
+	throw too_many_guests();
       }
 
-      // The user calling the service is the host.
-      invite_r i = make<invite>(cn, e, prologue.user, g);
-      i->notify();
-      return make<invite_id_payload>(i);
+      // Getting all the guests first. The directory does not offer a batched get, duplicates are gotten once.
+      db::connector dc(db::directory_database);
+      ::std::set<doc_id> seen;
+      ::std::vector<user_r> guests;
+
+      for (const auto& id: query->guest_ids){
+	if (seen.insert(id).second){
+	  guests.push_back(root_get<user>(dc, id).or_throw<user_does_not_exist>());
+	}
+      }
+
+      // The existence checks are document gets or answered by the event's guests filter.
+      ::std::vector<invite_r> invites;
+      invite_ids_payload_r r = make<invite_ids_payload>();
+
+      for (const user_r& g: guests){
+	// The user calling the service is the host.
+	if (invite_p i = invite::create_if_new(cn, e, prologue.user, g)){
+	  invites.push_back(*i);
+	  r->invite_ids.push_back((*i)->get_id());
+	}
+      }
+
+      // Notifying once all the invites are created, so that no notification is sent for a batch that fails.
+      for (const invite_r& i: invites){
+	notification::post(cn, i);
+      }
+      
+      return r;
     });
 
   // Only the invited user, the organizer of the event or the root user can inspect an invite.
@@ -1100,7 +1316,7 @@ namespace events {
     ([](const login_checker_prologue& prologue, const rfr<invite_id_payload>& query){
       db::connector cn{dbname};
       open_invite_r i = root_get<open_invite>(cn, query->invite_id).or_throw<invite_does_not_exist>();
-      i->decline(prologue.user);
+      i->decline(cn, prologue.user);
     });
 
   // Only the invited user can accept.
@@ -1130,14 +1346,23 @@ namespace events {
 	throw unauthorized();
       }
 
-      i->unpublish();
+      i->decline(cn);
     });
 
   // Anybody logged in can book a public event.
   // Must check that a booking does not exist yet.
   // Even the event organizer must make a booking if they want to be a guest. That ensures that inventory is properly decremented.
+  // When bookings are paced, users beyond the event's rate are not booked, the reply has no booking and tells when to
+  // come back. Coming back earlier does not lose the turn.
   auto _book = service<srv_tag<"book">>
     ([](const login_checker_prologue& prologue, const rfr<book_payload>& query){
+      // Before any database access.
+      if (get_admission_rate()){
+	if (time_t w = get_admission_control().admit(query->event_id, prologue.user->get_id())){
+	  return make<book_reply_payload>(w);
+	}
+      }
+      
       db::connector cn{dbname};
       event_r e = root_get<event>(cn, query->event_id).or_throw<event_does_not_exist>();
 
@@ -1145,30 +1370,73 @@ namespace events {
 	throw unauthorized();
       }
 
-      // Checking that no booking for the user exists yet.
-      if (booking_p b = e->get_booking(cn, prologue.user)){
-	throw booking_already_made();
-      }
-
+      // Creating the booking checks that no booking for the user exists yet, with or without an invite.
       // If there is an invite, we can remove it.
-      if (invite_p i = e->get_invite(cn, prologue.user)){
-	return make<booking_id_payload>((*i)->accept(cn, query->display_name, query->note));
+      if (invite_p i = e->lookup_invite(cn, prologue.user)){
+	return make<book_reply_payload>((*i)->accept(cn, query->display_name, query->note));
       }
 
       // It's a public event, the guest is their own host.
       // Creating the booking will increment the booking count of the event.
-      booking_r b = make<booking>(cn, e, prologue.user, prologue.user, query->display_name, query->note);
-      return make<booking_id_payload>(b);
+      booking_r b = booking::create(cn, e, prologue.user, prologue.user, query->display_name, query->note);
+      return make<book_reply_payload>(b);
+    });
+
+  // Waiting room. Gives the user a turn to book the event, and returns the number of seconds to wait for it. Does not
+  // touch the database.
+  auto _booking_admission = service<srv_tag<"booking_admission">>
+    ([](const login_checker_prologue& prologue, const rfr<event_id_payload>& query){
+      return make<retry_after_payload>(get_admission_rate() ? get_admission_control().enqueue(query->event_id, prologue.user->get_id()) : 0);
+    });
+
+  // Reserves a seat of an event for a few minutes, e.g., while the user checks out. A second call extends the hold. The
+  // seat is taken by the booking the user makes as guest, calling book or accepting an invite.
+  // Holds not used expire, their seats are given back by the sweep service below.
+  auto _seats_hold = service<srv_tag<"seats_hold">>
+    ([](const login_checker_prologue& prologue, const rfr<event_id_payload>& query){
+      db::connector cn{dbname};
+      event_r e = root_get<event>(cn, query->event_id).or_throw<event_does_not_exist>();
+
+      if (e->is_private() && !e->has_access(cn, prologue.user)){
+	throw unauthorized();
+      }
+
+      return make<seat_hold_expiry_payload>(seat_hold::hold(cn, e, prologue.user));
+    });
+
+  // Gives back the seat if not used yet.
+  auto _seats_release = service<srv_tag<"seats_release">>
+    ([](const login_checker_prologue& prologue, const rfr<event_id_payload>& query){
+      db::connector cn{dbname};
+      event_r e = root_get<event>(cn, query->event_id).or_throw<event_does_not_exist>();
+      seat_hold::release(cn, e, prologue.user);
+    });
+
+  // Gives back the seats of the expired holds. To be called periodically, e.g., every few minutes by cron. Until then
+  // the seats are only given back when their event is found full.
+  // Returns the number of holds removed.
+  auto _seat_holds_sweep = service<srv_tag<"seat_holds_sweep">, root_checker_prologue>
+    ([]{
+      db::connector cn{dbname};
+      return make<count_payload>(seat_hold::sweep(cn));
     });
 
   // The document identifier of the booking can be used to generate a 2D barcode that can be scanned at event
   // check-in.
+  // Conditional: if the query supplies the entity tag of the current booking data, the reply is empty (JSON object {}).
   auto _booking_get = service<srv_tag<"booking_get">>
-    ([](const login_checker_prologue& prologue, const rfr<booking_id_payload>& query){
+    ([](const login_checker_prologue& prologue, const rfr<booking_get_payload>& query) -> booking_and_event_data_with_etag_payload_p {
       db::connector cn{dbname};
       booking_r b = root_get<booking>(cn, query->booking_id).or_throw<booking_does_not_exist>();
       organizer_host_or_guest_checker()(b, prologue.user);
-      return make<booking_and_event_data_payload>(b);
+      etag t(b);
+
+      if (t == query->etag.get()){
+	HX2A_LOG(trace) << "Booking " << b->get_id() << " not modified.";
+	return {};
+      }
+      
+      return make<booking_and_event_data_with_etag_payload>(b, t.str());
     });
 
   // Only the user who performed the booking or the organizer of the event can cancel a booking.
@@ -1177,7 +1445,7 @@ namespace events {
       db::connector cn{dbname};
       booking_r b = root_get<booking>(cn, query->booking_id).or_throw<booking_does_not_exist>();
       organizer_or_guest_checker()(b, prologue.user);
-      b->cancel();
+      b->cancel(cn);
     });
 
   // Typically the GUI should display a 2D barcode for the doc id of the booking, and the check-in agent
@@ -1215,6 +1483,19 @@ namespace events {
   >
   _open_invites_per_user(config::get_id(dbname), open_invite::index_by_email);
 
+  // Same for the open invites where the user's contact is stored outside of the open invite.
+
+  paginated_services<
+    srv_tag<"open_invite_contacts_per_user">,
+    open_invite_contact,
+    projector<invite_details_payload>,
+    login_checker_prologue,
+    void,
+    user_email_adder,
+    json_leading_value_remover
+  >
+  _open_invite_contacts_per_user(config::get_id(dbname), open_invite_contact::index_by_email);
+
   // Paginated services for a user to list all their invites.
 
   paginated_services<
@@ -1241,6 +1522,98 @@ namespace events {
   >
   _bookings_per_user(config::get_id(dbname), booking::index_by_guest);
 
+  // Paginated services for a user to list their agenda, bookings and invites together by event start.
+  // Normal use is to send "startkey": [now] to get the upcoming events first.
+
+  paginated_services<
+    srv_tag<"agenda">,
+    agenda_item,
+    projector<agenda_item_data_payload>,
+    login_checker_prologue,
+    void,
+    user_doc_id_adder,
+    json_leading_value_remover
+  >
+  _agenda(config::get_id(dbname), agenda_item::index_by_user_and_event_start);
+
+  // Incremental synchronization of the lists above.
+  // The App supplies "startkey": [T] where T is the timestamp of its last synchronization (minus some margin for clock
+  // skew), and gets the documents created or updated since, plus the removals since in the removals list. In the steady
+  // state the replies are nearly empty.
+  // The event data nested in the bookings and invites are refreshed with conditional gets.
+
+  paginated_services<
+    srv_tag<"open_invites_per_user_since">,
+    open_invite,
+    projector<invite_details_payload>,
+    login_checker_prologue,
+    void,
+    user_email_adder,
+    json_leading_value_remover
+  >
+  _open_invites_per_user_since(config::get_id(dbname), open_invite::index_by_email_and_save_timestamp);
+
+  paginated_services<
+    srv_tag<"open_invite_contacts_per_user_since">,
+    open_invite_contact,
+    projector<invite_details_payload>,
+    login_checker_prologue,
+    void,
+    user_email_adder,
+    json_leading_value_remover
+  >
+  _open_invite_contacts_per_user_since(config::get_id(dbname), open_invite_contact::index_by_email_and_save_timestamp);
+
+  paginated_services<
+    srv_tag<"invites_per_user_since">,
+    invite,
+    projector<invite_details_payload>,
+    login_checker_prologue,
+    void,
+    user_doc_id_adder,
+    json_leading_value_remover
+  >
+  _invites_per_user_since(config::get_id(dbname), invite::index_by_guest_and_save_timestamp);
+
+  paginated_services<
+    srv_tag<"bookings_per_user_since">,
+    booking,
+    projector<booking_and_event_data_payload>,
+    login_checker_prologue,
+    void,
+    user_doc_id_adder,
+    json_leading_value_remover
+  >
+  _bookings_per_user_since(config::get_id(dbname), booking::index_by_guest_and_save_timestamp);
+
+  paginated_services<
+    srv_tag<"removals_per_user_since">,
+    removal,
+    projector<removal_data_payload>,
+    login_checker_prologue,
+    void,
+    user_doc_id_adder,
+    json_leading_value_remover
+  >
+  _removals_per_user_since(config::get_id(dbname), removal::index_by_user_and_creation_timestamp);
+
+  // To be called by the App before synchronizing incrementally, with the timestamp of its last synchronization.
+  // Throws if removals since have been swept. The App must then reload its lists in full.
+  auto _sync_check = service<srv_tag<"sync_check">>
+    ([](const login_checker_prologue&, const rfr<timestamp_payload>& query){
+      if (!removal::are_kept_since(query->timestamp)){
+	throw resync_required();
+      }
+    });
+
+  // Removes the removals older than the retention period. To be called periodically, e.g., daily by cron.
+  // Returns the number of removals removed.
+  auto _removals_sweep = service<srv_tag<"removals_sweep">, root_checker_prologue>
+    ([]{
+      db::connector cn{dbname};
+      return make<count_payload>(removal::sweep(cn));
+    });
+
   // Paginated services for an event organizer.
 
   // To list all the open invites for a given event.
@@ -1308,6 +1681,20 @@ namespace events {
     json_leading_value_remover
   >
   _events_per_organizer(config::get_id(dbname), event::index_by_organizer);
+
+  // Same, with the compact projection used by the App map pins. It does not follow the venue link beyond the position,
+  // nor the organizer and conversation links.
+
+  paginated_services<
+    srv_tag<"events_per_organizer_pins">,
+    event,
+    projector<event_pin_payload>,
+    login_checker_prologue,
+    void,
+    user_doc_id_adder,
+    json_leading_value_remover
+  >
+  _events_per_organizer_pins(config::get_id(dbname), event::index_by_organizer);
   
   // To list all the public events starting later than a given timestamp for a given venue.
 
@@ -1427,6 +1814,27 @@ namespace events {
   >
   _newsfeed(config::get_id(dbname), news::index_by_expiry_timestamp);
 
+  // Notifications services.
+
+  // Sends the notifications of the outbox that are due. To be called periodically, e.g., every minute by cron.
+  // Returns the number of notifications sent.
+  auto _notifications_drain = service<srv_tag<"notifications_drain">, root_checker_prologue>
+    ([]{
+      db::connector cn{dbname};
+      return make<count_payload>(notification::drain(cn));
+    });
+
+  // Client states services.
+
+  // Removes the client states not seen for a long time, and the ones superseded by a more recent one for the same token.
+  // To be called periodically, e.g., daily by cron.
+  // Returns the number of client states removed.
+  auto _client_states_sweep = service<srv_tag<"client_states_sweep">, root_checker_prologue>
+    ([]{
+      db::connector cn{client_state_dbname};
+      return make<count_payload>(client_state::sweep(cn));
+    });
+
   // Anybody can call it without login.
   auto _min_app_version = service<srv_tag<"min_app_version">>
     ([]{